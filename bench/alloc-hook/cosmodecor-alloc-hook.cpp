@@ -0,0 +1,94 @@
+/**
+ * libcosmodecor-alloc-hook, an operator new counting allocations per thread,
+ * for alloc_check builds of cosmodecor:
+ *
+ *   LD_PRELOAD=build/bench/alloc-hook/libcosmodecor-alloc-hook.so wayfire
+ *
+ * Being preloaded, it replaces the operator new of libstdc++ for Wayfire and
+ * every library it loads, plugins included.
+ */
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/** Per thread, so that the threads of the GL driver never count */
+static thread_local size_t allocations = 0;
+
+extern "C" __attribute__((visibility("default"))) size_t cosmodecor_alloc_count() {
+    return allocations;
+}
+
+static void *allocate(std::size_t size, std::size_t alignment) {
+    allocations++;
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+
+    /** aligned_alloc wants a multiple of the alignment */
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void *operator new(std::size_t size) {
+    if (void *ptr = allocate(size, 0)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    if (void *ptr = allocate(size, (std::size_t)alignment)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, 0);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
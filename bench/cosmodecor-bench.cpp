@@ -0,0 +1,398 @@
+/**
+ * cosmodecor-bench, a headless microbenchmark of the decoration hot paths:
+ * layout, text measurement, the rasterization of titles, buttons and icons,
+ * and the lookup of decorations in the transaction hook.
+ *
+ * Every benchmark is run for at least --min-time seconds, and the results are
+ * printed as JSON, with the time and the heap allocations of one operation.
+ *
+ * usage: cosmodecor-bench [--filter <substring>] [--min-time <seconds>]
+ */
+#include <cairo.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "cosmodecor-theme.hpp"
+#include "cosmodecor-layout.hpp"
+#include "cosmodecor-registry.hpp"
+#include "cosmodecor-margins.hpp"
+
+/** Every heap allocation made by the process, for allocations per operation */
+static std::atomic<size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace wf {
+    namespace cosmodecor {
+        namespace bench {
+            struct result_t {
+                std::string name, params;
+                size_t iterations;
+                double ns_per_op;
+                double allocs_per_op;
+            };
+
+            struct runner_t {
+                std::string filter;
+                double min_time = 0.5;
+                std::vector<result_t> results;
+
+                /**
+                 * Run an operation in batches of growing size, until a batch takes
+                 * at least min_time.
+                 *
+                 * @param items The items each call of the operation handles, results
+                 *  are given per item.
+                 */
+                void run(const std::string& name, const std::string& params, std::function<void()> op,
+                         size_t items = 1) {
+                    if (!filter.empty() && ((name + "/" + params).find(filter) == std::string::npos)) {
+                        return;
+                    }
+
+                    /** Warm up the caches the operation relies on */
+                    op();
+
+                    using clock = std::chrono::steady_clock;
+                    for (size_t batch = 1;; batch *= 2) {
+                        size_t allocs = allocations.load(std::memory_order_relaxed);
+                        auto start = clock::now();
+                        for (size_t i = 0; i < batch; i++) {
+                            op();
+                        }
+
+                        std::chrono::duration<double> elapsed = clock::now() - start;
+                        allocs = allocations.load(std::memory_order_relaxed) - allocs;
+                        if ((elapsed.count() >= min_time) || (batch >= (size_t(1) << 30))) {
+                            results.push_back({name, params, batch * items,
+                                               elapsed.count() * 1e9 / (batch * items),
+                                               (double)allocs / (batch * items)});
+                            fprintf(stderr, "%-24s %-40s %12.1f ns/op %8.2f allocs/op\n", name.c_str(),
+                                    params.c_str(), results.back().ns_per_op, results.back().allocs_per_op);
+                            return;
+                        }
+                    }
+                }
+
+                static std::string escape(const std::string& text) {
+                    std::string out;
+                    for (char c : text) {
+                        if ((c == '"') || (c == '\\')) {
+                            out += '\\';
+                        }
+
+                        out += c;
+                    }
+
+                    return out;
+                }
+
+                void print_json() const {
+                    printf("{\"benchmarks\":[");
+                    for (size_t i = 0; i < results.size(); i++) {
+                        auto& r = results[i];
+                        printf("%s\n  {\"name\":\"%s\",\"params\":\"%s\",\"iterations\":%zu,"
+                               "\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f}", i ? "," : "",
+                               escape(r.name).c_str(), escape(r.params).c_str(), r.iterations,
+                               r.ns_per_op, r.allocs_per_op);
+                    }
+
+                    printf("\n]}\n");
+                }
+            };
+
+            static const std::vector<std::string> layouts = {
+                "a | icon P4 title | minimize p maximize p close p | Atrtl -",
+                "P5 title | | minimize p maximize p close P5 -",
+                "icon p title | | close -",
+                "close p maximize p minimize | title | icon - - title -",
+                "a P5 title P5 a | | Abltr minimize p maximize p close A\\\\/ -",
+            };
+
+            static const std::vector<wf::dimensions_t> sizes = {
+                {320, 240}, {1280, 720}, {2560, 1440},
+            };
+
+            static const std::vector<std::string> titles = {
+                "kitty",
+                "~/src/cosmodecor: meson compile -C build",
+                "Mozilla Firefox — A fairly long page title that has to be ellipsized somewhere",
+                "Überprüfung der Änderungen – ñandú, 日本語のタイトル, emoji 🎉",
+            };
+
+            static const std::vector<double> scales = {1.0, 1.5, 2.0};
+
+            static const std::vector<std::string> button_styles = {
+                "cosmodecor", "wayfire", "simple", "reform",
+            };
+
+            static theme_options default_options(std::string layout, std::string button_style) {
+                return theme_options{
+                    .font = std::string{"sans-serif"},
+                    .font_size = 21,
+                    .active_title = wf::color_t{0x1d / 255.0, 0x1f / 255.0, 0x21 / 255.0, 1.0},
+                    .inactive_title = wf::color_t{0x1d / 255.0, 0x1f / 255.0, 0x21 / 255.0, 1.0},
+                    .max_title_size = 750,
+                    .border_size = std::string{"35 10"},
+                    .active_border = wf::color_t{0x1d / 255.0, 0x1f / 255.0, 0x21 / 255.0, 0.9},
+                    .inactive_border = wf::color_t{0x1d / 255.0, 0x1f / 255.0, 0x21 / 255.0, 0.9},
+                    .corner_radius = 15,
+                    .outline_size = 0,
+                    .active_outline = wf::color_t{0.0, 0.0, 0.0, 1.0},
+                    .inactive_outline = wf::color_t{0.0, 0.0, 0.0, 1.0},
+                    .button_size = 18,
+                    .button_style = button_style,
+                    .icon_size = 20,
+                    .active_accent = wf::color_t{0xf5 / 255.0, 0xf5 / 255.0, 0xf5 / 255.0, 1.0},
+                    .inactive_accent = wf::color_t{0xe1 / 255.0, 0xdf / 255.0, 0xfe / 255.0, 1.0},
+                    .padding_size = 8,
+                    .layout = layout,
+                    .ignore_views = std::string{"none"},
+                    .debug_mode = false,
+                    .round_on = std::string{"all"},
+                };
+            }
+
+            static std::string size_param(wf::dimensions_t size) {
+                return std::to_string(size.width) + "x" + std::to_string(size.height);
+            }
+
+            static std::string scale_param(double scale) {
+                char buffer[16];
+                snprintf(buffer, sizeof(buffer), "@%g", scale);
+                return buffer;
+            }
+
+            static void bench_layout(runner_t& runner) {
+                for (size_t l = 0; l < layouts.size(); l++) {
+                    decoration_theme_t theme{default_options(layouts[l], "cosmodecor")};
+                    decoration_layout_t layout{theme, [] (wlr_box) {}};
+                    auto title_size = theme.get_text_size(titles[1], 1.0);
+
+                    for (auto size : sizes) {
+                        runner.run("layout_resize", "layout" + std::to_string(l) + " " + size_param(size), [&] () {
+                            layout.resize(size.width, size.height, title_size, false);
+                        });
+                    }
+
+                    runner.run("layout_resize", "layout" + std::to_string(l) + " alternating", [&] () {
+                        for (auto size : sizes) {
+                            layout.resize(size.width, size.height, title_size, false);
+                        }
+                    });
+                }
+            }
+
+            static void bench_text(runner_t& runner) {
+                decoration_theme_t theme{default_options(layouts[0], "cosmodecor")};
+                for (size_t t = 0; t < titles.size(); t++) {
+                    for (double scale : scales) {
+                        std::string params = "title" + std::to_string(t) + " " + scale_param(scale);
+                        runner.run("get_text_size", params, [&] () {
+                            theme.get_text_size(titles[t], scale);
+                        });
+
+                        /** A new string every time, as with a title that keeps changing */
+                        size_t serial = 0;
+                        runner.run("get_text_size_uncached", params, [&] () {
+                            theme.get_text_size(titles[t] + std::to_string(serial++), scale);
+                        });
+
+                        /** Text sizes are logical, titles are rasterized in device pixels, as update_title does */
+                        auto logical = theme.get_text_size(titles[t], scale);
+                        wf::dimensions_t size = { (int)(logical.width * scale), (int)(logical.height * scale) };
+                        runner.run("form_title", params, [&] () {
+                            cairo_surface_destroy(theme.form_title(titles[t], size, HORIZONTAL, scale));
+                        });
+                        runner.run("form_title_vertical", params, [&] () {
+                            cairo_surface_destroy(theme.form_title(titles[t], size, VERTICAL, scale));
+                        });
+                    }
+                }
+            }
+
+            static void bench_buttons(runner_t& runner) {
+                static const std::pair<button_type_t, const char*> types[] = {
+                    {BUTTON_CLOSE, "close"}, {BUTTON_TOGGLE_MAXIMIZE, "maximize"},
+                    {BUTTON_MINIMIZE, "minimize"},
+                };
+
+                for (auto& style : button_styles) {
+                    if ((style == "reform") && !exists("/usr/share/cosmodecor/button-styles/reform/close.png")) {
+                        fprintf(stderr, "skipping the reform buttons, they are not installed\n");
+                        continue;
+                    }
+
+                    decoration_theme_t theme{default_options(layouts[0], style)};
+                    for (auto& [type, type_name] : types) {
+                        for (double scale : scales) {
+                            for (double hover : { 0.0, 0.5, -1.0 }) {
+                                char params[64];
+                                snprintf(params, sizeof(params), "%s %s hover=%g %s", style.c_str(),
+                                         type_name, hover, scale_param(scale).c_str());
+                                runner.run("form_button", params, [&] () {
+                                    cairo_surface_destroy(theme.form_button(type, hover, true, false, scale));
+                                });
+                            }
+                        }
+                    }
+                }
+            }
+
+            static void bench_svg(runner_t& runner) {
+                decoration_theme_t theme{default_options(layouts[0], "cosmodecor")};
+                std::string path = std::string{BENCH_DATA_DIR} + "/executable.svg";
+                for (double scale : scales) {
+                    int size = theme.get_icon_size() * scale;
+                    runner.run("surface_svg", "executable.svg " + scale_param(scale), [&] () {
+                        cairo_surface_destroy(theme.surface_svg(path, size));
+                    });
+                }
+            }
+
+            /**
+             * Stand-ins for transaction objects, holding custom data by type name as
+             * Wayfire's do, which can't be built without a running core. The decorators
+             * are found and their margins computed by the registry and margins cache of
+             * the plugin itself.
+             */
+            struct mock_object_t {
+                virtual ~mock_object_t() = default;
+            };
+
+            struct mock_data_t {
+                virtual ~mock_data_t() = default;
+            };
+
+            struct mock_toplevel_t : public mock_object_t {
+                std::unordered_map<std::string, std::unique_ptr<mock_data_t>> data;
+                wf::toplevel_state_t pending;
+            };
+
+            struct mock_surface_t : public mock_object_t {};
+
+            struct mock_decorator_t : public mock_data_t {
+                wf::decoration_margins_t border = {10, 10, 10, 35};
+                bool maximized_titlebar = true;
+                uint64_t border_serial = 1;
+                margins_cache_t cached_margins;
+
+                /** The margins as the hook computed them on every call before */
+                wf::decoration_margins_t compute(const wf::toplevel_state_t& state) const {
+                    if (state.fullscreen || (!maximized_titlebar && state.tiled_edges)) {
+                        return {0, 0, 0, 0};
+                    }
+
+                    return border;
+                }
+            };
+
+            /**
+             * The cost per object of the transaction hook, finding decorated
+             * toplevels by dynamic cast and type name as it used to, or by address.
+             */
+            static void bench_tx_hook(runner_t& runner) {
+                for (size_t count : { 1, 16, 256 }) {
+                    for (int others : { 0, 25 }) {
+                        std::vector<std::shared_ptr<mock_object_t>> objects;
+                        pointer_registry_t<mock_object_t, mock_decorator_t> registry;
+                        for (size_t i = 0; i < count; i++) {
+                            if ((int)(i % 100) < others) {
+                                objects.push_back(std::make_shared<mock_surface_t>());
+                                continue;
+                            }
+
+                            auto toplevel  = std::make_shared<mock_toplevel_t>();
+                            auto decorator = std::make_unique<mock_decorator_t>();
+                            registry.add(toplevel.get(), decorator.get());
+                            toplevel->data[typeid(mock_decorator_t).name()] = std::move(decorator);
+                            objects.push_back(toplevel);
+                        }
+
+                        std::string params = std::to_string(count) + " objects, " +
+                            std::to_string(others) + "% not toplevels";
+                        runner.run("tx_hook_by_type_name", params, [&] () {
+                            for (const auto& obj : objects) {
+                                if (auto toplevel = std::dynamic_pointer_cast<mock_toplevel_t>(obj)) {
+                                    auto it = toplevel->data.find(typeid(mock_decorator_t).name());
+                                    if (it != toplevel->data.end()) {
+                                        auto deco = dynamic_cast<mock_decorator_t*>(it->second.get());
+                                        toplevel->pending.margins = deco->compute(toplevel->pending);
+                                    }
+                                }
+                            }
+                        }, count);
+
+                        runner.run("tx_hook_by_address", params, [&] () {
+                            for (const auto& obj : objects) {
+                                if (auto deco = registry.find(obj.get())) {
+                                    auto& pending = static_cast<mock_toplevel_t*>(obj.get())->pending;
+                                    pending.margins = deco->cached_margins.get(pending, deco->maximized_titlebar,
+                                                                               deco->border, deco->border_serial);
+                                    continue;
+                                }
+
+                                /** Only objects nobody decorated are cast, as before */
+                                if (auto toplevel = std::dynamic_pointer_cast<mock_toplevel_t>(obj)) {
+                                    (void)toplevel;
+                                }
+                            }
+                        }, count);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    using namespace wf::cosmodecor;
+    bench::runner_t runner;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && (i + 1 < argc)) {
+            runner.filter = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time") && (i + 1 < argc)) {
+            runner.min_time = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--filter <substring>] [--min-time <seconds>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench::bench_layout(runner);
+    bench::bench_text(runner);
+    bench::bench_buttons(runner);
+    bench::bench_svg(runner);
+    bench::bench_tx_hook(runner);
+    runner.print_json();
+
+    decoration_theme_t::release_text_cache();
+    return 0;
+}
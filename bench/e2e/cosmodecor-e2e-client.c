@@ -0,0 +1,279 @@
+/*
+ * cosmodecor-e2e-client, a minimal xdg-shell client mapping many plain
+ * windows for the end-to-end benchmark.
+ *
+ * usage: cosmodecor-e2e-client [--windows <count>]
+ *
+ * Every window is filled with a solid color, and follows the sizes it is
+ * configured with. SIGUSR1 toggles a title storm, where every window changes
+ * its title at about 60Hz.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+
+#define STORM_INTERVAL_MS 16
+
+struct window {
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *toplevel;
+    struct wl_buffer *buffer;
+    bool buffer_busy;
+    int width, height;
+    int pending_width, pending_height;
+    unsigned index;
+};
+
+static struct wl_compositor *compositor;
+static struct wl_shm *shm;
+static struct xdg_wm_base *wm_base;
+static volatile sig_atomic_t storm_toggled = 0;
+static bool running = true;
+
+static void handle_usr1(int sig) {
+    (void)sig;
+    storm_toggled = 1;
+}
+
+static struct wl_buffer *create_buffer(int width, int height, uint32_t color) {
+    int stride = width * 4;
+    size_t size = (size_t)stride * height;
+    int fd = memfd_create("cosmodecor-e2e", MFD_CLOEXEC);
+    if ((fd < 0) || (ftruncate(fd, size) < 0)) {
+        perror("cosmodecor-e2e-client: shm");
+        exit(1);
+    }
+
+    uint32_t *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pixels == MAP_FAILED) {
+        perror("cosmodecor-e2e-client: mmap");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < size / 4; i++) {
+        pixels[i] = color;
+    }
+
+    munmap(pixels, size);
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+                                                         WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return buffer;
+}
+
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+    struct window *window = data;
+    /* A buffer replaced while the compositor still held it is destroyed once
+     * released, the current one is kept and only marked as free */
+    if (buffer != window->buffer) {
+        wl_buffer_destroy(buffer);
+    } else {
+        window->buffer_busy = false;
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static void draw(struct window *window) {
+    if (window->buffer && !window->buffer_busy) {
+        wl_buffer_destroy(window->buffer);
+    }
+
+    uint32_t color = 0xff202020 | ((window->index * 0x3a5f) & 0x7f7f7f);
+    window->buffer = create_buffer(window->width, window->height, color);
+    window->buffer_busy = true;
+    wl_buffer_add_listener(window->buffer, &buffer_listener, window);
+    wl_surface_attach(window->surface, window->buffer, 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, window->width, window->height);
+    wl_surface_commit(window->surface);
+}
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
+    struct window *window = data;
+    xdg_surface_ack_configure(xdg_surface, serial);
+
+    int width  = window->pending_width ? window->pending_width : window->width;
+    int height = window->pending_height ? window->pending_height : window->height;
+    if (!window->buffer || (width != window->width) || (height != window->height)) {
+        window->width  = width;
+        window->height = height;
+        draw(window);
+    } else {
+        wl_surface_commit(window->surface);
+    }
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel, int32_t width,
+                               int32_t height, struct wl_array *states) {
+    struct window *window = data;
+    (void)toplevel;
+    (void)states;
+    window->pending_width  = width;
+    window->pending_height = height;
+}
+
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
+    (void)data;
+    (void)toplevel;
+    running = false;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = toplevel_configure,
+    .close     = toplevel_close,
+};
+
+static void wm_base_ping(void *data, struct xdg_wm_base *base, uint32_t serial) {
+    (void)data;
+    xdg_wm_base_pong(base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_ping,
+};
+
+static void registry_global(void *data, struct wl_registry *registry, uint32_t name,
+                            const char *interface, uint32_t version) {
+    (void)data;
+    (void)version;
+    if (!strcmp(interface, wl_compositor_interface.name)) {
+        compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    } else if (!strcmp(interface, wl_shm_interface.name)) {
+        shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (!strcmp(interface, xdg_wm_base_interface.name)) {
+        wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global        = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static void set_title(struct window *window, unsigned serial) {
+    char title[64];
+    if (serial) {
+        snprintf(title, sizeof(title), "cosmodecor e2e window %u, update %u", window->index, serial);
+    } else {
+        snprintf(title, sizeof(title), "cosmodecor e2e window %u", window->index);
+    }
+
+    xdg_toplevel_set_title(window->toplevel, title);
+}
+
+int main(int argc, char **argv) {
+    unsigned count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--windows") && (i + 1 < argc)) {
+            count = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--windows <count>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    struct wl_display *display = wl_display_connect(NULL);
+    if (!display) {
+        fprintf(stderr, "cosmodecor-e2e-client: cannot connect to the compositor\n");
+        return 1;
+    }
+
+    struct wl_registry *registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, NULL);
+    wl_display_roundtrip(display);
+    if (!compositor || !shm || !wm_base) {
+        fprintf(stderr, "cosmodecor-e2e-client: the compositor lacks wl_shm or xdg-shell\n");
+        return 1;
+    }
+
+    struct sigaction action = { .sa_handler = handle_usr1 };
+    sigaction(SIGUSR1, &action, NULL);
+
+    struct window *windows = calloc(count, sizeof(*windows));
+    for (unsigned i = 0; i < count; i++) {
+        struct window *window = &windows[i];
+        window->index  = i;
+        window->width  = 400;
+        window->height = 300;
+        window->surface     = wl_compositor_create_surface(compositor);
+        window->xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, window->surface);
+        xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener, window);
+        window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+        xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+        xdg_toplevel_set_app_id(window->toplevel, "cosmodecor-e2e");
+        set_title(window, 0);
+        wl_surface_commit(window->surface);
+    }
+
+    bool storm = false;
+    unsigned serial = 0;
+    struct pollfd fd = { .fd = wl_display_get_fd(display), .events = POLLIN };
+    while (running) {
+        if (storm_toggled) {
+            storm_toggled = 0;
+            storm = !storm;
+        }
+
+        if (storm) {
+            serial++;
+            for (unsigned i = 0; i < count; i++) {
+                set_title(&windows[i], serial);
+            }
+        }
+
+        while (wl_display_prepare_read(display) != 0) {
+            wl_display_dispatch_pending(display);
+        }
+
+        wl_display_flush(display);
+        int ready = poll(&fd, 1, storm ? STORM_INTERVAL_MS : -1);
+        if ((ready < 0) && (errno != EINTR)) {
+            wl_display_cancel_read(display);
+            break;
+        }
+
+        if (ready > 0) {
+            if (wl_display_read_events(display) < 0) {
+                break;
+            }
+        } else {
+            wl_display_cancel_read(display);
+        }
+
+        if (wl_display_dispatch_pending(display) < 0) {
+            break;
+        }
+    }
+
+    wl_display_disconnect(display);
+    free(windows);
+    return 0;
+}
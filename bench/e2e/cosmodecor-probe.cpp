@@ -0,0 +1,314 @@
+/**
+ * cosmodecor-probe, a plugin measuring the compositor while run-e2e.sh drives
+ * it through the end-to-end scenarios.
+ *
+ * Commands are read, one per line, from the FIFO named by COSMODECOR_PROBE_FIFO:
+ *  - `begin <scenario>` starts recording, and drives the scenario if it needs
+ *    the compositor's help: `steady` and `title` repaint every frame,
+ *    `activation` focuses the next view every frame and `resize` resizes every
+ *    view every frame;
+ *  - `end` appends the results of the scenario, as a line of JSON, to the file
+ *    named by COSMODECOR_PROBE_OUT.
+ *
+ * The results hold percentiles of the time between frames and of the time
+ * spent rendering them, the latency from a view mapping to the end of the
+ * first frame of its output showing it decorated, and the resident memory of
+ * the compositor.
+ */
+#include <wayfire/plugin.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/toplevel-view.hpp>
+#include <wayfire/window-manager.hpp>
+#include <wayfire/debug.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    double ms_since(clock_type::time_point start, clock_type::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    /** @return The percentiles of the samples, as a JSON object */
+    std::string percentiles(std::vector<double> samples) {
+        std::ostringstream out;
+        out << "{\"count\":" << samples.size();
+        if (!samples.empty()) {
+            std::sort(samples.begin(), samples.end());
+            for (auto [name, p] : { std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99} }) {
+                out << ",\"" << name << "\":" << samples[(size_t)(p * (samples.size() - 1))];
+            }
+
+            out << ",\"max\":" << samples.back();
+        }
+
+        out << "}";
+        return out.str();
+    }
+
+    /** @return The resident memory of the compositor, in KiB */
+    long resident_kib() {
+        long pages = 0, resident = 0;
+        if (FILE *statm = fopen("/proc/self/statm", "r")) {
+            if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+                resident = 0;
+            }
+
+            fclose(statm);
+        }
+
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+}
+
+class cosmodecor_probe_t : public wf::plugin_interface_t {
+    struct output_hooks_t {
+        wf::effect_hook_t pre, post;
+    };
+
+    std::map<wf::output_t*, std::unique_ptr<output_hooks_t>> hooks;
+
+    std::string scenario;
+    bool recording = false;
+    size_t frame = 0;
+
+    clock_type::time_point frame_start, last_frame_start;
+    std::vector<double> frame_intervals, render_times, map_latencies;
+
+    /** Views mapped but not yet shown decorated, with the time they mapped at */
+    std::vector<std::pair<std::weak_ptr<wf::view_interface_t>, clock_type::time_point>> pending_maps;
+
+    int fifo = -1;
+    wl_event_source *fifo_source = nullptr;
+    std::string command_buffer;
+
+    wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped = [this] (wf::view_mapped_signal *ev) {
+        if (recording && wf::toplevel_cast(ev->view)) {
+            pending_maps.emplace_back(ev->view->weak_from_this(), clock_type::now());
+        }
+    };
+
+    wf::signal::connection_t<wf::output_added_signal> on_output_added = [this] (wf::output_added_signal *ev) {
+        add_hooks(ev->output);
+    };
+
+    wf::signal::connection_t<wf::output_pre_remove_signal> on_output_removed =
+        [this] (wf::output_pre_remove_signal *ev) {
+            remove_hooks(ev->output);
+        };
+
+    void add_hooks(wf::output_t *output) {
+        auto output_hooks = std::make_unique<output_hooks_t>();
+        output_hooks->pre  = [this, output] () { frame_begin(output); };
+        output_hooks->post = [this, output] () { frame_end(output); };
+        output->render->add_effect(&output_hooks->pre, wf::OUTPUT_EFFECT_PRE);
+        output->render->add_effect(&output_hooks->post, wf::OUTPUT_EFFECT_POST);
+        hooks[output] = std::move(output_hooks);
+    }
+
+    void remove_hooks(wf::output_t *output) {
+        auto it = hooks.find(output);
+        if (it != hooks.end()) {
+            output->render->rem_effect(&it->second->pre);
+            output->render->rem_effect(&it->second->post);
+            hooks.erase(it);
+        }
+    }
+
+    std::vector<wayfire_toplevel_view> get_toplevels() {
+        std::vector<wayfire_toplevel_view> views;
+        for (auto& view : wf::get_core().get_all_views()) {
+            if (auto toplevel = wf::toplevel_cast(view); toplevel && toplevel->is_mapped()) {
+                views.push_back(toplevel);
+            }
+        }
+
+        return views;
+    }
+
+    /** Do the compositor's part of the scenario, before the frame is rendered */
+    void drive_scenario() {
+        if (scenario == "activation") {
+            auto views = get_toplevels();
+            if (!views.empty()) {
+                wf::get_core().default_wm->focus_raise_view(views[frame % views.size()]);
+            }
+        } else if (scenario == "resize") {
+            /** A slow back and forth, as when dragging an edge */
+            int delta = 150 * std::sin(frame * 0.1);
+            for (auto& view : get_toplevels()) {
+                view->resize(std::max(200, 500 + delta), std::max(150, 350 + delta / 2));
+            }
+        }
+    }
+
+    void frame_begin(wf::output_t *output) {
+        if (!recording) {
+            return;
+        }
+
+        frame_start = clock_type::now();
+        if (frame > 0) {
+            frame_intervals.push_back(ms_since(last_frame_start, frame_start));
+        }
+
+        last_frame_start = frame_start;
+        drive_scenario();
+    }
+
+    void frame_end(wf::output_t *output) {
+        if (!recording) {
+            return;
+        }
+
+        auto now = clock_type::now();
+        render_times.push_back(ms_since(frame_start, now));
+        std::erase_if(pending_maps, [&] (const auto& pending) {
+            auto view = wf::toplevel_cast(pending.first.lock().get());
+            if (!view || !view->is_mapped()) {
+                return true;
+            }
+
+            /** The margins are committed along with the decoration, so a frame ending after they
+             * are current is the first one which could show the view decorated */
+            auto& margins = view->toplevel()->current().margins;
+            if ((view->get_output() != output) ||
+                (margins.left + margins.right + margins.top + margins.bottom == 0)) {
+                return false;
+            }
+
+            map_latencies.push_back(ms_since(pending.second, now));
+            return true;
+        });
+
+        frame++;
+
+        /** Every scenario but mapping and reloading keeps the outputs busy */
+        if ((scenario != "map") && (scenario != "reload")) {
+            output->render->damage_whole();
+        }
+    }
+
+    void begin(const std::string& name) {
+        scenario  = name;
+        recording = true;
+        frame     = 0;
+        frame_intervals.clear();
+        render_times.clear();
+        map_latencies.clear();
+        pending_maps.clear();
+
+        for (auto& [output, output_hooks] : hooks) {
+            output->render->damage_whole();
+        }
+    }
+
+    void end() {
+        if (!recording) {
+            return;
+        }
+
+        recording = false;
+
+        std::ostringstream line;
+        line << "{\"scenario\":\"" << scenario << "\",\"views\":" << get_toplevels().size() <<
+            ",\"frames\":" << frame << ",\"frame_interval_ms\":" << percentiles(frame_intervals) <<
+            ",\"render_ms\":" << percentiles(render_times) << ",\"map_to_frame_ms\":" <<
+            percentiles(map_latencies) << ",\"rss_kib\":" << resident_kib() << "}";
+
+        const char *path = getenv("COSMODECOR_PROBE_OUT");
+        if (FILE *out = fopen(path ? path : "/tmp/cosmodecor-probe.jsonl", "a")) {
+            fprintf(out, "%s\n", line.str().c_str());
+            fclose(out);
+        }
+
+        LOGI("cosmodecor-probe: ", line.str());
+    }
+
+    void handle_command(const std::string& command) {
+        if (command.rfind("begin ", 0) == 0) {
+            begin(command.substr(6));
+        } else if (command == "end") {
+            end();
+        } else if (!command.empty()) {
+            LOGE("cosmodecor-probe: unknown command ", command);
+        }
+    }
+
+    static int handle_fifo(int fd, uint32_t mask, void *data) {
+        auto probe = (cosmodecor_probe_t*)data;
+        char buffer[256];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            probe->command_buffer.append(buffer, length);
+        }
+
+        size_t newline;
+        while ((newline = probe->command_buffer.find('\n')) != std::string::npos) {
+            std::string command = probe->command_buffer.substr(0, newline);
+            probe->command_buffer.erase(0, newline + 1);
+            probe->handle_command(command);
+        }
+
+        return 0;
+    }
+
+public:
+    void init() override {
+        for (auto output : wf::get_core().output_layout->get_outputs()) {
+            add_hooks(output);
+        }
+
+        wf::get_core().output_layout->connect(&on_output_added);
+        wf::get_core().output_layout->connect(&on_output_removed);
+        wf::get_core().connect(&on_view_mapped);
+
+        const char *path = getenv("COSMODECOR_PROBE_FIFO");
+        if (!path) {
+            LOGE("cosmodecor-probe: COSMODECOR_PROBE_FIFO is not set, nothing will be measured");
+            return;
+        }
+
+        /** Opened for writing too, so that the FIFO never reads as closed between commands */
+        fifo = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fifo < 0) {
+            LOGE("cosmodecor-probe: cannot open ", path);
+            return;
+        }
+
+        fifo_source = wl_event_loop_add_fd(wf::get_core().ev_loop, fifo, WL_EVENT_READABLE,
+                                           handle_fifo, this);
+    }
+
+    void fini() override {
+        if (fifo_source) {
+            wl_event_source_remove(fifo_source);
+        }
+
+        if (fifo >= 0) {
+            close(fifo);
+        }
+
+        while (!hooks.empty()) {
+            remove_hooks(hooks.begin()->first);
+        }
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(cosmodecor_probe_t);
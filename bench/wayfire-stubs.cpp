@@ -0,0 +1,129 @@
+/**
+ * The symbols of the Wayfire core which the decoration code links against,
+ * and which a plugin finds in the compositor at runtime. The bench has no
+ * compositor, no main loop and no GL context, so these only do what the
+ * benchmarked paths need: options read as their defaults, idle calls never
+ * run, and anything reaching for the core or for GL aborts.
+ */
+#include <wayfire/core.hpp>
+#include <wayfire/debug.hpp>
+#include <wayfire/object.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/config/types.hpp>
+#include <wayfire/config/option.hpp>
+
+#include <chrono>
+#include <cstdlib>
+
+[[noreturn]] static void unavailable(const char *what) {
+    LOGE("cosmodecor-bench: ", what, " is not available without a compositor");
+    std::abort();
+}
+
+namespace wf {
+    compositor_core_t& get_core() {
+        unavailable("the compositor core");
+    }
+
+    std::vector<wf::output_t*> output_layout_t::get_outputs() {
+        unavailable("the output layout");
+    }
+
+    uint32_t get_current_time() {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    namespace detail {
+        std::shared_ptr<config::option_base_t> load_raw_option(const std::string& name) {
+            if (name == "cosmodecor/memory_budget") {
+                return std::make_shared<config::option_t<int>>(name, 0);
+            }
+
+            if (name == "cosmodecor/debug_mode") {
+                return std::make_shared<config::option_t<bool>>(name, false);
+            }
+
+            return nullptr;
+        }
+
+        void option_wrapper_debug_message(const std::string& option_name, const std::runtime_error& err) {
+            LOGE("cosmodecor-bench: no option ", option_name, ": ", err.what());
+            std::abort();
+        }
+
+        void option_wrapper_debug_message(const std::string& option_name, const std::logic_error& err) {
+            LOGE("cosmodecor-bench: bad option ", option_name, ": ", err.what());
+            std::abort();
+        }
+    }
+
+    /* Without a main loop, idle work is dropped; the bench measures the calls, not their effects */
+    wl_idle_call::wl_idle_call() {}
+    wl_idle_call::~wl_idle_call() {}
+    void wl_idle_call::set_callback(callback_t call) {}
+    void wl_idle_call::run_once() {}
+    void wl_idle_call::run_once(callback_t call) {}
+    void wl_idle_call::disconnect() {}
+    bool wl_idle_call::is_connected() const {
+        return false;
+    }
+
+    void wl_idle_call::execute() {}
+
+    custom_data_t *object_base_t::_fetch_data(std::string name) {
+        unavailable("per object data");
+    }
+
+    void object_base_t::_store_data(std::unique_ptr<custom_data_t> data, std::string name) {
+        unavailable("per object data");
+    }
+
+    void object_base_t::erase_data(std::string name) {
+        unavailable("per object data");
+    }
+
+    region_t::region_t() {
+        pixman_region32_init(&_region);
+    }
+
+    region_t::region_t(const region_t& other) {
+        pixman_region32_init(&_region);
+        pixman_region32_copy(&_region, &other._region);
+    }
+
+    region_t::region_t(region_t&& other) {
+        pixman_region32_init(&_region);
+        std::swap(_region, other._region);
+    }
+
+    region_t::~region_t() {
+        pixman_region32_fini(&_region);
+    }
+
+    region_t& region_t::operator |=(const wlr_box& box) {
+        pixman_region32_union_rect(&_region, &_region, box.x, box.y, box.width, box.height);
+        return *this;
+    }
+}
+
+bool operator &(const wf::geometry_t& rect, const wf::point_t& point) {
+    return (point.x >= rect.x) && (point.x < rect.x + rect.width) &&
+           (point.y >= rect.y) && (point.y < rect.y + rect.height);
+}
+
+namespace OpenGL {
+    void render_begin() {
+        unavailable("OpenGL");
+    }
+
+    void render_end() {
+        unavailable("OpenGL");
+    }
+}
+
+void gl_call(const char *func, uint32_t line, const char *glfunc) {}
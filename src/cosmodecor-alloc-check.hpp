@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef COSMODECOR_ALLOC_CHECK
+#include <wayfire/debug.hpp>
+
+#include <cstdlib>
+#include <dlfcn.h>
+
+namespace wf {
+    namespace cosmodecor {
+        /**
+         * Checks that frames which change nothing never allocate, in builds with
+         * the alloc_check option. Allocations are counted per thread by the
+         * operator new of libcosmodecor-alloc-hook.so, which has to be preloaded
+         * into Wayfire, so that it replaces the one of libstdc++ everywhere.
+         */
+        class alloc_check_t {
+        public:
+            /** @return The allocations made by this thread so far, 0 without the hook */
+            static size_t count() {
+                using counter_t = size_t (*)();
+                static counter_t counter = [] () {
+                    auto counter = (counter_t)dlsym(RTLD_DEFAULT, "cosmodecor_alloc_count");
+                    if (!counter) {
+                        LOGE("cosmodecor: alloc_check is on, but libcosmodecor-alloc-hook.so is not "
+                             "preloaded, allocations are not checked");
+                    }
+
+                    return counter;
+                }();
+
+                return counter ? counter() : 0;
+            }
+
+            /** Abort if this thread allocated since the given count */
+            static void expect_none(size_t since, const char *where) {
+                size_t allocations = count() - since;
+                if (allocations > 0) {
+                    LOGE("cosmodecor: ", allocations, " allocations in a steady ", where);
+                    std::abort();
+                }
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,425 @@
+#include <wayfire/core.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/object.hpp>
+
+#include "cosmodecor-atlas.hpp"
+#include "cosmodecor-profile.hpp"
+#include "cosmodecor-memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace wf {
+    namespace cosmodecor {
+        /** The size of a regular page, larger assets get a page of their own */
+        static constexpr int PAGE_SIZE = 1024;
+        /** Transparent texels around each slot, so that filtering never bleeds */
+        static constexpr int PADDING = 1;
+
+        /** A row of slots of similar heights */
+        struct atlas_shelf_t {
+            int y, height;
+            /** Free spans, as x and width, sorted by x */
+            std::vector<std::pair<int, int>> free;
+        };
+
+        struct atlas_page_t {
+            GLuint tex;
+            int width, height;
+            /** Whether the page holds coverage masks, in a single alpha channel */
+            bool mask;
+            std::vector<atlas_shelf_t> shelves;
+            /** The height taken by the shelves */
+            int used_height = 0;
+            size_t live = 0;
+            int64_t live_area = 0;
+        };
+
+        /** The atlas of an output, dropped along with the output */
+        struct output_atlas_t : public wf::custom_data_t {
+            std::shared_ptr<texture_atlas_t> atlas = std::make_shared<texture_atlas_t>();
+        };
+
+        /** Used while rendering without an output, which should not happen */
+        static std::shared_ptr<texture_atlas_t> fallback_atlas;
+        static uint64_t upload_count = 0;
+
+        /** @return The GL memory of a page */
+        static int64_t page_bytes(const atlas_page_t *page) {
+            return (int64_t)page->width * page->height * (page->mask ? 1 : 4);
+        }
+
+        GLuint atlas_slot_t::get_texture() const {
+            return page->tex;
+        }
+
+        wf::dimensions_t atlas_slot_t::get_page_size() const {
+            return { page->width, page->height };
+        }
+
+        bool atlas_slot_t::is_mask() const {
+            return page->mask;
+        }
+
+        int64_t atlas_slot_t::get_bytes() const {
+            return (int64_t)rect.width * rect.height * (page->mask ? 1 : 4);
+        }
+
+        std::shared_ptr<texture_atlas_t> texture_atlas_t::get(wf::output_t *output) {
+            if (!output) {
+                if (!fallback_atlas) {
+                    fallback_atlas = std::make_shared<texture_atlas_t>();
+                }
+
+                return fallback_atlas;
+            }
+
+            return output->get_data_safe<output_atlas_t>()->atlas;
+        }
+
+        void texture_atlas_t::release_all() {
+            for (auto output : wf::get_core().output_layout->get_outputs()) {
+                output->erase_data<output_atlas_t>();
+            }
+
+            fallback_atlas.reset();
+        }
+
+        uint64_t texture_atlas_t::get_upload_count() {
+            return upload_count;
+        }
+
+        texture_atlas_t::~texture_atlas_t() {
+            /** Every slot holds a reference, so only empty pages remain */
+            while (!pages.empty()) {
+                destroy_page(pages.back().get());
+            }
+        }
+
+        void texture_atlas_t::upload(cairo_surface_t *surface, atlas_handle_t& handle) {
+            profile_scope_t profile{PROFILE_UPLOAD};
+            phase_scope_t phase{PHASE_UPLOAD};
+            upload_count++;
+            cairo_surface_flush(surface);
+            int width  = cairo_image_surface_get_width(surface);
+            int height = cairo_image_surface_get_height(surface);
+            int stride = cairo_image_surface_get_stride(surface);
+            const unsigned char *data = cairo_image_surface_get_data(surface);
+            bool mask = (cairo_image_surface_get_format(surface) == CAIRO_FORMAT_A8);
+            int bpp   = mask ? 1 : 4;
+
+            if (!handle || (handle->atlas != this) || (handle->rect.width != width) ||
+                (handle->rect.height != height) || (handle->is_mask() != mask)) {
+                handle = allocate(width, height, mask);
+            }
+
+            /** The padding is uploaded too, clearing whatever a previous slot left */
+            int padded_width  = width + 2 * PADDING;
+            int padded_height = height + 2 * PADDING;
+            std::vector<unsigned char> buffer((size_t)padded_width * padded_height * bpp, 0);
+            for (int y = 0; y < height; y++) {
+                std::memcpy(&buffer[((size_t)(y + PADDING) * padded_width + PADDING) * bpp],
+                            data + (size_t)y * stride, (size_t)width * bpp);
+            }
+
+            phase_profile_t::count(COUNTER_UPLOADED_BYTES, buffer.size());
+            OpenGL::render_begin();
+            write(handle->page, { handle->rect.x - PADDING, handle->rect.y - PADDING,
+                padded_width, padded_height }, buffer.data());
+            OpenGL::render_end();
+        }
+
+        void texture_atlas_t::write(atlas_page_t *page, wf::geometry_t rect,
+                                    const unsigned char *texels) {
+            GLenum format = page->mask ? GL_ALPHA : GL_RGBA;
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, page->tex));
+            GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, page->mask ? 1 : 4));
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height,
+                                    format, GL_UNSIGNED_BYTE, texels));
+            GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        }
+
+        atlas_handle_t texture_atlas_t::allocate(int width, int height, bool mask) {
+            int padded_width  = std::max(width, 1) + 2 * PADDING;
+            int padded_height = std::max(height, 1) + 2 * PADDING;
+
+            wf::geometry_t rect;
+            atlas_page_t *page = nullptr;
+            if ((padded_width <= PAGE_SIZE) && (padded_height <= PAGE_SIZE)) {
+                for (auto& candidate : pages) {
+                    if ((candidate->mask == mask) &&
+                        place(candidate.get(), padded_width, padded_height, rect)) {
+                        page = candidate.get();
+                        break;
+                    }
+                }
+            }
+
+            if (!page) {
+                page = create_page(std::max(padded_width, PAGE_SIZE),
+                                   std::max(padded_height, PAGE_SIZE), mask);
+                place(page, padded_width, padded_height, rect);
+            }
+
+            page->live++;
+            page->live_area += (int64_t)padded_width * padded_height;
+            memory_ledger_t::get().add(MEMORY_ATLAS_SLOTS,
+                                       (int64_t)padded_width * padded_height * (mask ? 1 : 4));
+            phase_profile_t::count(COUNTER_SLOTS_CREATED);
+
+            auto slot = new atlas_slot_t{ page, { rect.x + PADDING, rect.y + PADDING, width, height },
+                this };
+            slots.insert(slot);
+
+            auto self = shared_from_this();
+            return atlas_handle_t(slot, [self] (atlas_slot_t *slot) {
+                self->release(slot);
+                delete slot;
+            });
+        }
+
+        void texture_atlas_t::release(atlas_slot_t *slot) {
+            atlas_page_t *page = slot->page;
+            wf::geometry_t rect = {
+                slot->rect.x - PADDING, slot->rect.y - PADDING,
+                std::max(slot->rect.width, 1) + 2 * PADDING, std::max(slot->rect.height, 1) + 2 * PADDING
+            };
+
+            free_rect(page, rect);
+            memory_ledger_t::get().add(MEMORY_ATLAS_SLOTS,
+                                       -(int64_t)rect.width * rect.height * (page->mask ? 1 : 4));
+            page->live--;
+            page->live_area -= (int64_t)rect.width * rect.height;
+            slots.erase(slot);
+
+            /** Keep one regular page of each kind around, windows come and go all the time */
+            bool dedicated = (page->width > PAGE_SIZE) || (page->height > PAGE_SIZE);
+            auto kind = std::count_if(pages.begin(), pages.end(),
+                                      [&] (const auto& p) { return p->mask == page->mask; });
+            if ((page->live == 0) && (dedicated || (kind > 1))) {
+                destroy_page(page);
+            } else if (!page->mask && is_sparse()) {
+                idle_compact.run_once([this] () { compact(); });
+            }
+        }
+
+        bool texture_atlas_t::place(atlas_page_t *page, int width, int height, wf::geometry_t& rect) {
+            /** The lowest shelf that fits without wasting too much of its height */
+            atlas_shelf_t *best = nullptr;
+            for (auto& shelf : page->shelves) {
+                if ((shelf.height < height) || (shelf.height > height + height / 4 + 4)) {
+                    continue;
+                }
+
+                bool fits = std::any_of(shelf.free.begin(), shelf.free.end(),
+                                        [&] (const auto& span) { return span.second >= width; });
+                if (fits && (!best || (shelf.height < best->height))) {
+                    best = &shelf;
+                }
+            }
+
+            if (!best) {
+                if ((page->used_height + height > page->height) || (width > page->width)) {
+                    return false;
+                }
+
+                page->shelves.push_back({ page->used_height, height, { { 0, page->width } } });
+                page->used_height += height;
+                best = &page->shelves.back();
+            }
+
+            for (auto it = best->free.begin(); it != best->free.end(); ++it) {
+                if (it->second >= width) {
+                    rect = { it->first, best->y, width, height };
+                    it->first  += width;
+                    it->second -= width;
+                    if (it->second == 0) {
+                        best->free.erase(it);
+                    }
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void texture_atlas_t::free_rect(atlas_page_t *page, wf::geometry_t rect) {
+            auto shelf = std::find_if(page->shelves.begin(), page->shelves.end(),
+                                      [&] (const auto& shelf) { return shelf.y == rect.y; });
+            if (shelf == page->shelves.end()) {
+                return;
+            }
+
+            auto& free = shelf->free;
+            auto it = std::lower_bound(free.begin(), free.end(), std::make_pair(rect.x, 0));
+            it = free.insert(it, { rect.x, rect.width });
+
+            /** Merge with the following span, then with the preceding one */
+            if ((it + 1 != free.end()) && (it->first + it->second == (it + 1)->first)) {
+                it->second += (it + 1)->second;
+                free.erase(it + 1);
+            }
+
+            if ((it != free.begin()) && ((it - 1)->first + (it - 1)->second == it->first)) {
+                (it - 1)->second += it->second;
+                free.erase(it);
+            }
+
+            /** Empty shelves at the end give their height back to the page */
+            while (!page->shelves.empty()) {
+                auto& last = page->shelves.back();
+                if ((last.free.size() != 1) || (last.free[0].second != page->width)) {
+                    break;
+                }
+
+                page->used_height = last.y;
+                page->shelves.pop_back();
+            }
+        }
+
+        atlas_page_t *texture_atlas_t::create_page(int width, int height, bool mask) {
+            auto page = std::make_unique<atlas_page_t>();
+            page->width  = width;
+            page->height = height;
+            page->mask   = mask;
+            phase_profile_t::count(COUNTER_PAGES_CREATED);
+
+            OpenGL::render_begin();
+            GL_CALL(glGenTextures(1, &page->tex));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, page->tex));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            if (mask) {
+                /** A quarter of the memory, the color is given when drawing */
+                GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0, GL_ALPHA,
+                                     GL_UNSIGNED_BYTE, nullptr));
+            } else {
+                /** Cairo stores pixels as BGRA, swap them when sampling like cairo-util does */
+                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
+                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
+                GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                                     GL_UNSIGNED_BYTE, nullptr));
+            }
+
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+            OpenGL::render_end();
+
+            memory_ledger_t::get().add(MEMORY_ATLAS, page_bytes(page.get()));
+            pages.push_back(std::move(page));
+            return pages.back().get();
+        }
+
+        void texture_atlas_t::destroy_page(atlas_page_t *page) {
+            OpenGL::render_begin();
+            GL_CALL(glDeleteTextures(1, &page->tex));
+            OpenGL::render_end();
+            memory_ledger_t::get().add(MEMORY_ATLAS, -page_bytes(page));
+
+            pages.erase(std::remove_if(pages.begin(), pages.end(),
+                                       [&] (const auto& p) { return p.get() == page; }), pages.end());
+        }
+
+        bool texture_atlas_t::is_sparse() const {
+            int64_t capacity = 0, live = 0;
+            int count = 0;
+            for (const auto& page : pages) {
+                if (!page->mask) {
+                    capacity += (int64_t)page->width * page->height;
+                    live     += page->live_area;
+                    count++;
+                }
+            }
+
+            return (count >= 2) && (live * 2 < capacity);
+        }
+
+        void texture_atlas_t::compact() {
+            while (is_sparse()) {
+                /** Empty the sparsest page into the others, if they have room for it */
+                atlas_page_t *source = nullptr;
+                for (auto& page : pages) {
+                    if (!page->mask && (!source || (page->live_area < source->live_area))) {
+                        source = page.get();
+                    }
+                }
+
+                struct move_t {
+                    atlas_slot_t *slot;
+                    atlas_page_t *page;
+                    wf::geometry_t rect;
+                };
+
+                std::vector<move_t> moves;
+                bool fits = true;
+                for (auto slot : slots) {
+                    if (slot->page != source) {
+                        continue;
+                    }
+
+                    wf::geometry_t padded = {
+                        slot->rect.x - PADDING, slot->rect.y - PADDING,
+                        std::max(slot->rect.width, 1) + 2 * PADDING,
+                        std::max(slot->rect.height, 1) + 2 * PADDING
+                    };
+
+                    move_t move = { slot, nullptr, padded };
+                    for (auto& page : pages) {
+                        if ((page.get() != source) && !page->mask &&
+                            place(page.get(), padded.width, padded.height, move.rect)) {
+                            move.page = page.get();
+                            break;
+                        }
+                    }
+
+                    if (!move.page) {
+                        fits = false;
+                        break;
+                    }
+
+                    moves.push_back(move);
+                }
+
+                if (!fits) {
+                    for (auto& move : moves) {
+                        free_rect(move.page, move.rect);
+                    }
+
+                    return;
+                }
+
+                /** Slots are copied on the GPU, from the source page bound as a framebuffer */
+                GLuint fbo = 0;
+                OpenGL::render_begin();
+                GL_CALL(glGenFramebuffers(1, &fbo));
+                GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+                GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                               GL_TEXTURE_2D, source->tex, 0));
+
+                for (auto& move : moves) {
+                    GL_CALL(glBindTexture(GL_TEXTURE_2D, move.page->tex));
+                    GL_CALL(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, move.rect.x, move.rect.y,
+                                                move.slot->rect.x - PADDING, move.slot->rect.y - PADDING,
+                                                move.rect.width, move.rect.height));
+
+                    move.page->live++;
+                    move.page->live_area += (int64_t)move.rect.width * move.rect.height;
+                    move.slot->page = move.page;
+                    move.slot->rect.x = move.rect.x + PADDING;
+                    move.slot->rect.y = move.rect.y + PADDING;
+                }
+
+                GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+                GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+                GL_CALL(glDeleteFramebuffers(1, &fbo));
+
+                OpenGL::render_end();
+
+                destroy_page(source);
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <wayfire/opengl.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/util.hpp>
+
+#include <cairo/cairo.h>
+
+namespace wf {
+    namespace cosmodecor {
+        struct atlas_page_t;
+        class texture_atlas_t;
+
+        /** A rectangle of an atlas page, holding a single asset */
+        struct atlas_slot_t {
+            /** The page of the slot, slots move between pages on compaction */
+            atlas_page_t *page;
+            /** The texels of the asset on the page */
+            wf::geometry_t rect;
+            /** The atlas owning the page */
+            texture_atlas_t *atlas;
+
+            /** @return The GL texture of the slot's page */
+            GLuint get_texture() const;
+
+            /** @return The size of the slot's page, in texels */
+            wf::dimensions_t get_page_size() const;
+
+            /** @return Whether the slot holds a coverage mask, to be tinted when drawn */
+            bool is_mask() const;
+
+            /** @return The GL memory of the slot, in bytes */
+            int64_t get_bytes() const;
+        };
+
+        /** A reference to a slot, which is freed along with the last reference */
+        using atlas_handle_t = std::shared_ptr<atlas_slot_t>;
+
+        /**
+         * Packs the small textures of all decorations on an output, titles, icons
+         * and buttons, into a few large pages, so that a decoration is drawn with
+         * very few texture binds and the GL object count does not grow with the
+         * number of windows.
+         *
+         * Pages are split into shelves of similar heights. Freed slots go back to
+         * their shelf, empty pages are freed, and sparse pages are moved into the
+         * others once the main loop goes idle.
+         *
+         * Coverage masks, text and monochrome glyphs, live on separate pages with
+         * a single 8-bit channel. Those can't be read back through a framebuffer,
+         * so mask pages are never compacted, only freed once empty.
+         */
+        class texture_atlas_t : public std::enable_shared_from_this<texture_atlas_t> {
+        public:
+            /**
+             * @return The atlas of the given output, created on first use. All
+             *  outputs share the GL context, so slots can be drawn on any output.
+             */
+            static std::shared_ptr<texture_atlas_t> get(wf::output_t *output);
+
+            /** Drop the atlases of all outputs, pages stay alive while they have slots */
+            static void release_all();
+
+            /** @return The uploads made to any atlas so far, to tell frames which drew something new */
+            static uint64_t get_upload_count();
+
+            texture_atlas_t() = default;
+            ~texture_atlas_t();
+            texture_atlas_t(const texture_atlas_t &) = delete;
+            texture_atlas_t& operator =(const texture_atlas_t&) = delete;
+
+            /**
+             * Upload a cairo surface to the atlas, in the handle's slot if it is on
+             * this atlas and has the same size and format, or in a new slot otherwise.
+             *
+             * @param surface An ARGB32 surface, or an A8 surface for a coverage mask.
+             * @param handle The handle to update.
+             */
+            void upload(cairo_surface_t *surface, atlas_handle_t& handle);
+
+            /** Move the slots of sparse color pages into the other pages, freeing them */
+            void compact();
+
+        private:
+            std::vector<std::unique_ptr<atlas_page_t>> pages;
+            std::unordered_set<atlas_slot_t*> slots;
+            wf::wl_idle_call idle_compact;
+
+            atlas_handle_t allocate(int width, int height, bool mask);
+            /** Upload padded texels to a rectangle of a page, with a current GL context */
+            void write(atlas_page_t *page, wf::geometry_t rect, const unsigned char *texels);
+            void release(atlas_slot_t *slot);
+
+            /** Find room for a padded rectangle on a page */
+            bool place(atlas_page_t *page, int width, int height, wf::geometry_t& rect);
+            /** Give a padded rectangle back to its shelf */
+            void free_rect(atlas_page_t *page, wf::geometry_t rect);
+
+            atlas_page_t *create_page(int width, int height, bool mask);
+            void destroy_page(atlas_page_t *page);
+
+            /** @return Whether the color pages hold much less than they could */
+            bool is_sparse() const;
+        };
+    }
+}
@@ -25,10 +25,11 @@ namespace wf {
         }
 
         void button_t::set_active(bool active) {
-            if (this->active != active) {
-                this->active = active;
-                add_idle_damage();
-            }
+            /**
+             * Buttons look the same in both states, and the decoration damages
+             * itself on activation, so there is nothing to draw again.
+             */
+            this->active = active;
         }
 
         void button_t::set_maximized(uint32_t edges) {
@@ -66,31 +67,47 @@ namespace wf {
             add_idle_damage();
         }
 
-        void button_t::render(const wf::render_target_t& fb, wf::geometry_t geometry,
-                              wf::geometry_t scissor) {
-
+        const atlas_handle_t& button_t::get_texture(double scale, texture_atlas_t& atlas) {
             if (this->texture_dirty) {
-                update_texture(fb.scale);
+                this->scaled_textures.clear();
+                this->texture_dirty = false;
             }
 
-            OpenGL::render_begin(fb);
-            fb.logic_scissor(scissor);
-            OpenGL::render_texture(button_texture.tex, fb, geometry, {1, 1, 1, 1},
-                                   OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
-            OpenGL::render_end();
+            if (auto texture = this->scaled_textures.get(scale)) {
+                this->button_texture = *texture;
+            } else {
+                update_texture(scale, atlas);
+            }
 
             if (this->hover.running()) {
                 add_idle_damage();
             }
+
+            return button_texture;
         }
 
-        void button_t::update_texture(double scale) {
+        void button_t::update_texture(double scale, texture_atlas_t& atlas) {
+            /** A single scale reuses the slot, as hover animations redraw every frame */
+            atlas_handle_t texture = (this->scaled_textures.size() == 0) ?
+                std::move(this->button_texture) : atlas_handle_t{};
             auto surface = theme.form_button(type, hover, active, maximized, scale);
-            OpenGL::render_begin();
-            cairo_surface_upload_to_texture(surface, this->button_texture);
-            OpenGL::render_end();
+            atlas.upload(surface, texture);
             cairo_surface_destroy(surface);
-            this->texture_dirty = false;
+            this->button_texture = this->scaled_textures.put(scale, texture);
+        }
+
+        int64_t button_t::get_memory_usage() const {
+            int64_t bytes = 0;
+            scaled_textures.for_each([&] (const atlas_handle_t& handle) {
+                bytes += handle ? handle->get_bytes() : 0;
+            });
+
+            return bytes;
+        }
+
+        void button_t::evict_textures() {
+            button_texture.reset();
+            scaled_textures.clear();
         }
 
         void button_t::add_idle_damage() {
@@ -6,12 +6,14 @@
 #include <wayfire/render-manager.hpp>
 #include <wayfire/view.hpp>
 #include <wayfire/util/duration.hpp>
-#include <wayfire/plugins/common/simple-texture.hpp>
 //#include "cairo-util.hpp"
 #include <wayfire/plugins/common/cairo-util.hpp>
 
 #include <cairo/cairo.h>
 
+#include "cosmodecor-atlas.hpp"
+#include "cosmodecor-lru.hpp"
+
 namespace wf {
     namespace cosmodecor {
         class decoration_theme_t;
@@ -68,22 +70,30 @@ namespace wf {
             void set_pressed(bool is_pressed);
 
             /**
-             * Render the button on the given framebuffer at the given coordinates.
-             * Precondition: set_button_type() has been called, otherwise result is no-op
+             * Get the button's texture, redrawing it first if it is out of date.
+             * Keeps the button damaged while its hover animation runs.
+             * Precondition: set_button_type() has been called.
              *
-             * @param buffer The target framebuffer
-             * @param geometry The geometry of the button, in logical coordinates
-             * @param scissor The scissor rectangle to render.
+             * @param scale The scale of the target framebuffer
+             * @param atlas The atlas to upload the texture to
              */
-            void render(const wf::render_target_t& buffer, wf::geometry_t geometry,
-                        wf::geometry_t scissor);
+            const atlas_handle_t& get_texture(double scale, texture_atlas_t& atlas);
+
+            /** @return The memory of the button's textures, in bytes */
+            int64_t get_memory_usage() const;
+
+            /** Drop the button's textures, they are drawn again when next asked for */
+            void evict_textures();
 
         private:
             const decoration_theme_t& theme;
 
             /* Whether the button needs repaint */
             button_type_t type;
-            wf::simple_texture_t button_texture;
+            /** The texture at the scale last asked for */
+            atlas_handle_t button_texture;
+            /** The textures of the scales the button was recently drawn at */
+            lru_cache_t<double, atlas_handle_t> scaled_textures{3};
 
             /* Whether the button is currently being hovered */
             bool is_hovered = false;
@@ -105,7 +115,7 @@ namespace wf {
             /**
              * Redraw the button surface and store it as a texture
              */
-            void update_texture(double scale);
+            void update_texture(double scale, texture_atlas_t& atlas);
         };
     }
 }
@@ -0,0 +1,365 @@
+#include <wayfire/opengl.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+
+#include "cosmodecor-draw-list.hpp"
+#include "cosmodecor-profile.hpp"
+
+#include <algorithm>
+
+namespace wf {
+    namespace cosmodecor {
+        /** x, y, u, v, r, g, b, a, mode */
+        static constexpr int VERTEX_SIZE = 9;
+
+        static const char *vertex_source =
+            R"(#version 100
+attribute highp vec2 position;
+attribute highp vec2 uvPosition;
+attribute highp vec4 color;
+attribute highp float mode;
+
+varying highp vec2 pos;
+varying highp vec2 uvpos;
+varying highp vec4 vcolor;
+varying highp float vmode;
+
+uniform mat4 MVP;
+
+void main() {
+    gl_Position = MVP * vec4(position.xy, 0.0, 1.0);
+    pos = position;
+    uvpos = uvPosition;
+    vcolor = color;
+    vmode = mode;
+})";
+
+        /**
+         * Frame pieces are shaded with the signed distance to the frame's rounded
+         * box, antialiased over one pixel. No derivatives or extensions are used,
+         * so that software rasterizers like llvmpipe run it as well.
+         */
+        static const char *fragment_source =
+            R"(#version 100
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+
+varying vec2 pos;
+varying vec2 uvpos;
+varying vec4 vcolor;
+varying float vmode;
+
+uniform sampler2D smp;
+
+/* x, y, width, height of the frame, in logical pixels */
+uniform vec4 frame;
+/* Corner radii: bottom right, top right, bottom left, top left */
+uniform vec4 radii;
+uniform float outline;
+uniform float scale;
+uniform vec4 border_color;
+uniform vec4 outline_color;
+
+float rounded_box(vec2 p, vec2 b, vec4 r) {
+    r.xy = (p.x > 0.0) ? r.xy : r.zw;
+    r.x  = (p.y > 0.0) ? r.x : r.y;
+    vec2 q = abs(p) - b + r.x;
+    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r.x;
+}
+
+vec4 frame_color() {
+    vec2 half_size = frame.zw * 0.5;
+    float d = rounded_box(pos - frame.xy - half_size, half_size, radii) * scale;
+    float coverage = clamp(0.5 - d, 0.0, 1.0);
+    float o = (outline > 0.0) ? clamp(d + outline * scale + 0.5, 0.0, 1.0) : 0.0;
+    return mix(border_color, outline_color, o) * coverage;
+}
+
+void main() {
+    if (vmode < 0.5) {
+        gl_FragColor = vcolor;
+    } else if (vmode < 1.5) {
+        gl_FragColor = texture2D(smp, uvpos) * vcolor;
+    } else if (vmode < 2.5) {
+        gl_FragColor = frame_color();
+    } else {
+        gl_FragColor = vcolor * texture2D(smp, uvpos).a;
+    }
+})";
+
+        static OpenGL::program_t program;
+        static bool program_ready = false;
+
+        void draw_list_t::clear() {
+            vertices.clear();
+            runs.clear();
+        }
+
+        void draw_list_t::push_quad(wf::geometry_t g, float u1, float v1, float u2, float v2,
+                                    wf::color_t color, GLuint texture, quad_mode_t mode) {
+            if (g.width <= 0 || g.height <= 0) {
+                return;
+            }
+
+            float x1 = g.x, y1 = g.y, x2 = g.x + g.width, y2 = g.y + g.height;
+            float shade = mode;
+            const GLfloat quad[6][VERTEX_SIZE] = {
+                { x1, y1, u1, v1, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+                { x2, y1, u2, v1, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+                { x2, y2, u2, v2, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+                { x1, y1, u1, v1, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+                { x2, y2, u2, v2, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+                { x1, y2, u1, v2, (float)color.r, (float)color.g, (float)color.b, (float)color.a, shade },
+            };
+
+            GLint first = vertices.size() / VERTEX_SIZE;
+            vertices.insert(vertices.end(), &quad[0][0], &quad[0][0] + 6 * VERTEX_SIZE);
+
+            /** Solid rectangles and frame pieces never sample, so they can join any run */
+            if (!runs.empty() && ((texture == 0) || (runs.back().texture == texture) ||
+                                  (runs.back().texture == 0))) {
+                if (runs.back().texture == 0) {
+                    runs.back().texture = texture;
+                }
+
+                runs.back().count += 6;
+            } else {
+                runs.push_back({ texture, first, 6 });
+            }
+        }
+
+        void draw_list_t::add_rectangle(wf::geometry_t g, wf::color_t color) {
+            push_quad(g, 0, 0, 0, 0, color, 0, QUAD_SOLID);
+        }
+
+        void draw_list_t::add_rectangle(wf::geometry_t g, wf::color_t color, wf::geometry_t clip) {
+            push_quad(wf::geometry_intersection(g, clip), 0, 0, 0, 0, color, 0, QUAD_SOLID);
+        }
+
+        void draw_list_t::set_frame(const frame_params_t& frame) {
+            this->frame = frame;
+        }
+
+        void draw_list_t::add_frame(wf::geometry_t g) {
+            push_quad(g, 0, 0, 0, 0, { 0.0, 0.0, 0.0, 0.0 }, 0, QUAD_FRAME);
+        }
+
+        /** @return The size of the slot's page, in the units of its rectangle */
+        static wf::pointf_t page_size(const atlas_slot_t& slot) {
+            auto size = slot.get_page_size();
+            return { (double)size.width, (double)size.height };
+        }
+
+        void draw_list_t::add_texture(const atlas_slot_t& slot, wf::geometry_t g,
+                                      uint32_t bits, wf::geometry_t clip) {
+            add_texture(slot.get_texture(), slot.rect, page_size(slot), g, bits, clip);
+        }
+
+        void draw_list_t::add_texture(GLuint texture, wf::geometry_t src, wf::pointf_t size,
+                                      wf::geometry_t g, uint32_t bits, wf::geometry_t clip) {
+            push_texture(texture, src, size, g, bits, clip, { 1.0, 1.0, 1.0, 1.0 }, QUAD_TEXTURED);
+        }
+
+        void draw_list_t::add_mask(const atlas_slot_t& slot, wf::geometry_t g, uint32_t bits,
+                                   wf::geometry_t clip, wf::color_t color) {
+            push_texture(slot.get_texture(), slot.rect, page_size(slot), g, bits, clip,
+                         color, QUAD_MASK);
+        }
+
+        void draw_list_t::push_texture(GLuint texture, wf::geometry_t src, wf::pointf_t size,
+                                       wf::geometry_t g, uint32_t bits, wf::geometry_t clip,
+                                       wf::color_t color, quad_mode_t mode) {
+            if ((g.width <= 0) || (g.height <= 0)) {
+                return;
+            }
+
+            wf::geometry_t visible = wf::geometry_intersection(g, clip);
+            if (visible.width <= 0 || visible.height <= 0) {
+                return;
+            }
+
+            /** Texture coordinates of the visible part, as render_texture maps them */
+            float u1 = (float)(visible.x - g.x) / g.width;
+            float u2 = (float)(visible.x + visible.width - g.x) / g.width;
+            float v1 = (float)(visible.y - g.y) / g.height;
+            float v2 = (float)(visible.y + visible.height - g.y) / g.height;
+            if (bits & OpenGL::TEXTURE_TRANSFORM_INVERT_X) {
+                u1 = 1.0f - u1;
+                u2 = 1.0f - u2;
+            }
+
+            if (bits & OpenGL::TEXTURE_TRANSFORM_INVERT_Y) {
+                v1 = 1.0f - v1;
+                v2 = 1.0f - v2;
+            }
+
+            /** Then into the shown part of the texture */
+            auto to_u = [&] (float u) { return (float)((src.x + u * src.width) / size.x); };
+            auto to_v = [&] (float v) { return (float)((src.y + v * src.height) / size.y); };
+            push_quad(visible, to_u(u1), to_v(v1), to_u(u2), to_v(v2), color, texture, mode);
+        }
+
+        void draw_list_t::add_texture(const atlas_slot_t& slot, wf::geometry_t g,
+                                      uint32_t bits) {
+            add_texture(slot, g, bits, g);
+        }
+
+        void draw_list_t::submit(const wf::render_target_t& fb, const wf::region_t& damage) {
+            if (runs.empty() || damage.empty()) {
+                return;
+            }
+
+            phase_scope_t phase{PHASE_SUBMIT};
+            OpenGL::render_begin(fb);
+            if (!program_ready) {
+                program.compile(vertex_source, fragment_source);
+                program_ready = true;
+            }
+
+            const GLsizei stride = VERTEX_SIZE * sizeof(GLfloat);
+            program.use(wf::TEXTURE_TYPE_RGBA);
+            program.uniformMatrix4f("MVP", fb.get_orthographic_projection());
+            program.uniform1i("smp", 0);
+            program.attrib_pointer("position", 2, stride, vertices.data());
+            program.attrib_pointer("uvPosition", 2, stride, vertices.data() + 2);
+            program.attrib_pointer("color", 4, stride, vertices.data() + 4);
+            program.attrib_pointer("mode", 1, stride, vertices.data() + 8);
+
+            /** Radii can't exceed half of the frame, or the distance breaks down */
+            int max_radius = std::min(frame.box.width, frame.box.height) / 2;
+            auto radius = [&] (int r) { return (float)std::clamp(r, 0, std::max(max_radius, 0)); };
+            auto color  = [] (wf::color_t c) { return glm::vec4(c.r, c.g, c.b, c.a); };
+            program.uniform4f("frame", glm::vec4(frame.box.x, frame.box.y, frame.box.width, frame.box.height));
+            program.uniform4f("radii", glm::vec4(radius(frame.br), radius(frame.tr),
+                                                 radius(frame.bl), radius(frame.tl)));
+            program.uniform1f("outline", frame.outline);
+            program.uniform1f("scale", fb.scale);
+            program.uniform4f("border_color", color(frame.border_color));
+            program.uniform4f("outline_color", color(frame.outline_color));
+
+            GL_CALL(glEnable(GL_BLEND));
+            GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+            GL_CALL(glActiveTexture(GL_TEXTURE0));
+
+            fb.logic_scissor(damage.get_extents());
+            for (const auto& run : runs) {
+                GL_CALL(glBindTexture(GL_TEXTURE_2D, run.texture));
+                GL_CALL(glDrawArrays(GL_TRIANGLES, run.first, run.count));
+            }
+
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+            program.deactivate();
+            OpenGL::render_end();
+        }
+
+        bool plan_primitive_t::operator ==(const plan_primitive_t& other) const {
+            return (geometry == other.geometry) && (bounds == other.bounds) &&
+                   (colors == other.colors) && (textures[0] == other.textures[0]) &&
+                   (textures[1] == other.textures[1]) && (button == other.button) &&
+                   (bits == other.bits) && (frame == other.frame);
+        }
+
+        void render_plan_t::clear() {
+            primitives.clear();
+            dirty = true;
+        }
+
+        void render_plan_t::add(const plan_primitive_t& primitive) {
+            if (primitive.bounds.width <= 0 || primitive.bounds.height <= 0) {
+                return;
+            }
+
+            /** Plans hold a few dozen primitives at most, and are rarely rebuilt */
+            if (std::find(primitives.begin(), primitives.end(), primitive) == primitives.end()) {
+                primitives.push_back(primitive);
+            }
+        }
+
+        void render_plan_t::add_rectangle(wf::geometry_t g, color_set_t colors) {
+            add({ g, g, colors, { nullptr, nullptr }, nullptr, 0, false });
+        }
+
+        void render_plan_t::add_texture(const atlas_handle_t *active,
+                                        const atlas_handle_t *inactive,
+                                        wf::geometry_t g, uint32_t bits, wf::geometry_t clip) {
+            add({ g, wf::geometry_intersection(g, clip), {}, { inactive, active }, nullptr, bits, false });
+        }
+
+        void render_plan_t::add_mask(const atlas_handle_t *mask, color_set_t colors,
+                                     wf::geometry_t g, uint32_t bits, wf::geometry_t clip) {
+            add({ g, wf::geometry_intersection(g, clip), colors, { mask, mask }, nullptr, bits, false });
+        }
+
+        void render_plan_t::add_button(button_t *button, wf::geometry_t g, wf::geometry_t clip) {
+            add({ g, wf::geometry_intersection(g, clip), {}, { nullptr, nullptr }, button,
+                  OpenGL::TEXTURE_TRANSFORM_INVERT_Y, false });
+        }
+
+        void render_plan_t::add_frame(wf::geometry_t g) {
+            add({ g, g, {}, { nullptr, nullptr }, nullptr, 0, true });
+        }
+
+        bool render_plan_t::only_frame_within(wf::geometry_t box) const {
+            return std::all_of(primitives.begin(), primitives.end(), [&] (const auto& primitive) {
+                wf::geometry_t in = wf::geometry_intersection(primitive.bounds, box);
+                return primitive.frame || (in.width <= 0) || (in.height <= 0);
+            });
+        }
+
+        void render_plan_t::set_frame(const frame_params_t& inactive, const frame_params_t& active) {
+            frames[0] = inactive;
+            frames[1] = active;
+        }
+
+        void render_plan_t::execute(draw_list_t& list, wf::point_t origin,
+                                    const wf::region_t& damage, bool active, double scale,
+                                    texture_atlas_t& atlas) const {
+            frame_params_t frame = frames[active];
+            frame.box = frame.box + origin;
+            list.set_frame(frame);
+
+            for (const auto& primitive : primitives) {
+                wf::geometry_t bounds = primitive.bounds + origin;
+                wf::geometry_t geometry = primitive.geometry + origin;
+                const atlas_handle_t *texture = primitive.textures[active];
+
+                bool fetched = false;
+                for (const auto& box : damage) {
+                    wf::geometry_t clip = wf::geometry_intersection(bounds, wlr_box_from_pixman_box(box));
+                    if (clip.width <= 0 || clip.height <= 0) {
+                        continue;
+                    }
+
+                    if (primitive.button && !fetched) {
+                        primitive.button->set_active(active);
+                        texture = &primitive.button->get_texture(scale, atlas);
+                        fetched = true;
+                    }
+
+                    if (primitive.frame) {
+                        list.add_frame(clip);
+                    } else if (texture) {
+                        if (*texture && (*texture)->is_mask()) {
+                            list.add_mask(**texture, geometry, primitive.bits, clip,
+                                          active ? primitive.colors.active : primitive.colors.inactive);
+                        } else if (*texture) {
+                            list.add_texture(**texture, geometry, primitive.bits, clip);
+                        }
+                    } else {
+                        list.add_rectangle(clip, active ? primitive.colors.active :
+                                           primitive.colors.inactive);
+                    }
+                }
+            }
+        }
+
+        void draw_list_t::release_program() {
+            if (program_ready) {
+                program.free_resources();
+                program_ready = false;
+            }
+        }
+    }
+}
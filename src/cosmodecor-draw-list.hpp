@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <wayfire/opengl.hpp>
+#include <wayfire/region.hpp>
+
+#include "cosmodecor-theme.hpp"
+#include "cosmodecor-atlas.hpp"
+
+namespace wf {
+    namespace cosmodecor {
+        /**
+         * The decoration frame, drawn analytically: a rounded box with a border
+         * and an outline along its outer edge.
+         */
+        struct frame_params_t {
+            /** The outer box of the frame, in logical coordinates */
+            wf::geometry_t box;
+            /** Radius per corner, in logical pixels */
+            int tr, tl, bl, br;
+            /** The outline size, in logical pixels */
+            int outline;
+            /** Premultiplied colors */
+            wf::color_t border_color, outline_color;
+        };
+
+        /**
+         * Collects every rectangle, textured quad and piece of the frame of a
+         * decoration, and submits them with a single program, in a single render
+         * pass.
+         *
+         * Quads are drawn in the order they were added. Consecutive quads sharing a
+         * texture, as well as all solid rectangles and frame pieces, are drawn with
+         * one call.
+         */
+        class draw_list_t {
+        public:
+            /** Remove all quads, keeping the allocated buffers */
+            void clear();
+
+            /**
+             * Add a solid rectangle.
+             * @param g The geometry of the rectangle, in logical coordinates.
+             * @param color The premultiplied color of the rectangle.
+             */
+            void add_rectangle(wf::geometry_t g, wf::color_t color);
+            void add_rectangle(wf::geometry_t g, wf::color_t color, wf::geometry_t clip);
+
+            /**
+             * Add a textured quad.
+             * @param slot The atlas slot holding the texture.
+             * @param g The geometry of the quad, in logical coordinates.
+             * @param bits OpenGL::TEXTURE_TRANSFORM_* bits, as for OpenGL::render_texture.
+             * @param clip Only the part of the quad inside of this box is drawn.
+             */
+            void add_texture(const atlas_slot_t& slot, wf::geometry_t g,
+                             uint32_t bits, wf::geometry_t clip);
+            void add_texture(const atlas_slot_t& slot, wf::geometry_t g,
+                             uint32_t bits = 0);
+
+            /**
+             * Add a quad showing part of a texture, stretched over the quad.
+             * @param texture The GL texture.
+             * @param src The part of the texture to show, in units of size.
+             * @param size The size of the whole texture, fractional when its units are
+             *  not texels, as for framebuffers rendered at a fractional scale.
+             */
+            void add_texture(GLuint texture, wf::geometry_t src, wf::pointf_t size,
+                             wf::geometry_t g, uint32_t bits, wf::geometry_t clip);
+
+            /**
+             * Add a quad filled with a color through a coverage mask.
+             * @param slot The atlas slot holding the mask.
+             * @param color The premultiplied color of the quad.
+             */
+            void add_mask(const atlas_slot_t& slot, wf::geometry_t g, uint32_t bits,
+                          wf::geometry_t clip, wf::color_t color);
+
+            /** Set the frame drawn by the pieces added with add_frame() */
+            void set_frame(const frame_params_t& frame);
+
+            /**
+             * Add a piece of the frame, shaded with the frame's signed distance
+             * function. Pieces must not overlap each other.
+             */
+            void add_frame(wf::geometry_t g);
+
+            /**
+             * Draw all collected quads on the framebuffer. The quads are expected to
+             * be clipped to the damage already, it is only used as a safety scissor.
+             */
+            void submit(const wf::render_target_t& fb, const wf::region_t& damage);
+
+            /** Free the shared program, must be called with a current GL context */
+            static void release_program();
+
+        private:
+            struct run_t {
+                GLuint texture;
+                GLint first;
+                GLsizei count;
+            };
+
+            enum quad_mode_t {
+                QUAD_SOLID    = 0,
+                QUAD_TEXTURED = 1,
+                QUAD_FRAME    = 2,
+                QUAD_MASK     = 3
+            };
+
+            /** Interleaved vertices: position, uv, color and how to shade them */
+            std::vector<GLfloat> vertices;
+            std::vector<run_t> runs;
+            frame_params_t frame{};
+
+            void push_quad(wf::geometry_t g, float u1, float v1, float u2, float v2,
+                           wf::color_t color, GLuint texture, quad_mode_t mode);
+            void push_texture(GLuint texture, wf::geometry_t src, wf::pointf_t size,
+                              wf::geometry_t g, uint32_t bits, wf::geometry_t clip,
+                              wf::color_t color, quad_mode_t mode);
+        };
+
+        /** A primitive of a render plan, relative to the decoration's origin */
+        struct plan_primitive_t {
+            /** The geometry of the primitive */
+            wf::geometry_t geometry;
+            /** The part of the geometry which is ever drawn */
+            wf::geometry_t bounds;
+            /** Premultiplied colors of solid primitives and masks */
+            color_set_t colors;
+            /** Textures indexed by activation, null for solid primitives */
+            const atlas_handle_t *textures[2];
+            /** Buttons hand out their texture on each frame instead */
+            button_t *button;
+            uint32_t bits;
+            /** Whether this is a piece of the frame */
+            bool frame;
+
+            bool operator ==(const plan_primitive_t& other) const;
+        };
+
+        /**
+         * The primitives of a decoration, computed when its layout changes. Each
+         * primitive appears once, and is drawn at most once per damaged pixel.
+         */
+        class render_plan_t {
+        public:
+            /** Remove all primitives, marking the plan for a rebuild */
+            void clear();
+
+            /** @return Whether the plan needs to be built again */
+            bool is_dirty() const {
+                return dirty;
+            }
+
+            /** Mark the plan as up to date */
+            void set_built() {
+                dirty = false;
+            }
+
+            /** Add a solid rectangle, colors must be premultiplied */
+            void add_rectangle(wf::geometry_t g, color_set_t colors);
+
+            /**
+             * Add a textured quad, the handles are only dereferenced when the plan
+             * is executed, and skipped while they are empty.
+             * @param clip Only the part of the quad inside of this box is drawn.
+             */
+            void add_texture(const atlas_handle_t *active, const atlas_handle_t *inactive,
+                             wf::geometry_t g, uint32_t bits, wf::geometry_t clip);
+
+            /**
+             * Add a coverage mask drawn in the colors of the activation states, the
+             * handle is dereferenced like the ones of add_texture().
+             */
+            void add_mask(const atlas_handle_t *mask, color_set_t colors,
+                          wf::geometry_t g, uint32_t bits, wf::geometry_t clip);
+
+            /** Add a button, which is asked for its texture on every frame */
+            void add_button(button_t *button, wf::geometry_t g, wf::geometry_t clip);
+
+            /** Add a piece of the frame, see draw_list_t::add_frame() */
+            void add_frame(wf::geometry_t g);
+
+            /** @return Whether only frame pieces intersect the box */
+            bool only_frame_within(wf::geometry_t box) const;
+
+            /**
+             * Describe the frame drawn by the frame pieces, relative to the origin.
+             * Colors must be premultiplied.
+             */
+            void set_frame(const frame_params_t& inactive, const frame_params_t& active);
+
+            /**
+             * Add every primitive intersecting the damage to the draw list, clipped
+             * against each damaged box.
+             * @param origin The position of the decoration's origin on the target.
+             * @param atlas The atlas buttons upload their textures to.
+             */
+            void execute(draw_list_t& list, wf::point_t origin, const wf::region_t& damage,
+                         bool active, double scale, texture_atlas_t& atlas) const;
+
+        private:
+            std::vector<plan_primitive_t> primitives;
+            /** The frame, indexed by activation */
+            frame_params_t frames[2] = {};
+            bool dirty = true;
+
+            void add(const plan_primitive_t& primitive);
+        };
+    }
+}
@@ -5,7 +5,9 @@
 
 #include "cosmodecor-layout.hpp"
 #include "cosmodecor-theme.hpp"
+#include "cosmodecor-profile.hpp"
 
+#include <algorithm>
 #include <fstream>
 
 namespace wf {
@@ -63,7 +65,7 @@ namespace wf {
             return edge;
         }
 
-        std::string decoration_area_t::get_corners() const {
+        const std::string& decoration_area_t::get_corners() const {
             return corners;
         }
 
@@ -77,6 +79,89 @@ namespace wf {
             return *button;
         }
 
+        void hit_index_t::build(const std::vector<std::unique_ptr<decoration_area_t>>& areas) {
+            xs.clear();
+            ys.clear();
+            for (auto& area : areas) {
+                auto g = area->get_geometry();
+                if ((g.width > 0) && (g.height > 0)) {
+                    xs.insert(xs.end(), { g.x, g.x + g.width });
+                    ys.insert(ys.end(), { g.y, g.y + g.height });
+                }
+            }
+
+            for (auto coords : { &xs, &ys }) {
+                std::sort(coords->begin(), coords->end());
+                coords->erase(std::unique(coords->begin(), coords->end()), coords->end());
+            }
+
+            size_t columns = xs.empty() ? 0 : xs.size() - 1;
+            size_t rows    = ys.empty() ? 0 : ys.size() - 1;
+            cells.assign(columns * rows, {});
+
+            auto paint = [&] (const decoration_area_t& area, auto fn) {
+                auto g = area.get_geometry();
+                if ((g.width <= 0) || (g.height <= 0)) {
+                    return;
+                }
+
+                size_t x0 = std::lower_bound(xs.begin(), xs.end(), g.x) - xs.begin();
+                size_t x1 = std::lower_bound(xs.begin(), xs.end(), g.x + g.width) - xs.begin();
+                size_t y0 = std::lower_bound(ys.begin(), ys.end(), g.y) - ys.begin();
+                size_t y1 = std::lower_bound(ys.begin(), ys.end(), g.y + g.height) - ys.begin();
+                for (size_t y = y0; y < y1; y++) {
+                    for (size_t x = x0; x < x1; x++) {
+                        fn(cells[y * columns + x]);
+                    }
+                }
+            };
+
+            // Painted last to first, so that the first area wins, then buttons over the rest
+            for (auto it = areas.rbegin(); it != areas.rend(); ++it) {
+                auto& area = **it;
+                if (area.get_type() == DECORATION_AREA_BUTTON) {
+                    continue;
+                }
+
+                paint(area, [&] (cell_t& cell) {
+                    cell.area = &area;
+                    if (area.get_type() & AREA_RESIZE_BIT) {
+                        cell.edges |= (area.get_type() & ~AREA_RESIZE_BIT);
+                    }
+                });
+            }
+
+            for (auto it = areas.rbegin(); it != areas.rend(); ++it) {
+                if ((*it)->get_type() == DECORATION_AREA_BUTTON) {
+                    paint(**it, [&] (cell_t& cell) { cell.area = it->get(); });
+                }
+            }
+        }
+
+        const hit_index_t::cell_t *hit_index_t::cell_at(wf::point_t point) const {
+            ptrdiff_t x = std::upper_bound(xs.begin(), xs.end(), point.x) - xs.begin() - 1;
+            ptrdiff_t y = std::upper_bound(ys.begin(), ys.end(), point.y) - ys.begin() - 1;
+            if ((x < 0) || (y < 0) || (x >= (ptrdiff_t)xs.size() - 1) || (y >= (ptrdiff_t)ys.size() - 1)) {
+                return nullptr;
+            }
+
+            return &cells[y * (xs.size() - 1) + x];
+        }
+
+        nonstd::observer_ptr<decoration_area_t> hit_index_t::find(wf::point_t point) const {
+            auto cell = cell_at(point);
+            if (!cell) {
+                return nullptr;
+            }
+
+            return nonstd::make_observer(cell->area);
+        }
+
+        uint32_t hit_index_t::get_resize_edges(wf::point_t point) const {
+            auto cell = cell_at(point);
+            return cell ? cell->edges : 0;
+        }
+
         border_size_t decoration_layout_t::parse_border(const std::string border_size_str) {
             std::stringstream stream((std::string)border_size_str);
             int current_size;
@@ -108,6 +193,7 @@ namespace wf {
             button_size(theme.get_button_size()),
             icon_size(theme.get_icon_size()),
             padding_size(theme.get_padding_size()),
+            max_title_size(theme.get_max_title_size()),
             theme(theme),
             damage_callback(callback)
         {}
@@ -135,6 +221,25 @@ namespace wf {
             const wf::point_t &l = { width, height - border_size.top - border_size.bottom };
             wf::point_t title = { title_size.width, title_size.height };
 
+            // Length of a symbol along its edge, titles excluded
+            auto symbol_length = [&](const std::string& type) -> int {
+                if (type == "icon") {
+                    return icon_size;
+                } else if (type == "p") {
+                    return padding_size;
+                } else if (type[0] == 'P') {
+                    int delta;
+                    std::stringstream num;
+                    num << type.substr(1);
+                    num >> delta;
+                    return delta;
+                } else if (type != "title" && type != "a" && type[0] != 'A') {
+                    return button_size;
+                }
+
+                return 0;
+            };
+
             // Matrix that transforms said elements
             matrix<int> m = { 1, 0, 0, 1 };
 
@@ -168,26 +273,24 @@ namespace wf {
                     // Variables for background and accent definition
                     std::string last_accent;
                     int counter = 0;
+
+                    // The title gets what the other symbols leave of the edge, ellipsized to fit
+                    int others = 0;
+                    for (auto vec : { left, center, right }) {
+                        for (auto type : vec) {
+                            others += symbol_length(type);
+                        }
+                    }
+
+                    int available = std::max(0, std::min(max_title_size, abs(trans(l).x) - others));
+                    title = { std::min(title_size.width, available), title_size.height };
+
                     for (auto vec : { left, center, right }) {
                         if (vec != left) {
                             int region_length = 0;
 
                             for (auto type : vec) {
-                                if (type == "title")	{
-                                    region_length += title_size.width;
-                                } else if (type == "icon") {
-                                    region_length += icon_size;
-                                } else if (type == "p") {
-                                    region_length += padding_size;
-                                } else if (type[0] == 'P') {
-                                    int delta;
-                                    std::stringstream num;
-                                    num << type.substr(1);
-                                    num >> delta;
-                                    region_length += delta;
-                                } else if (type != "a" && type[0] != 'A') {
-                                    region_length += button_size;
-                                }
+                                region_length += (type == "title") ? title.x : symbol_length(type);
                             }
 
                             if (vec == center) {
@@ -204,7 +307,7 @@ namespace wf {
                             int delta = 0;
 
                             if (type == "title") {
-                                delta = title_size.width;
+                                delta = title.x;
                                 out_padding = (max_height - title_size.height) / 2;
                                 cur_g = {
                                     o.x + trans(p()).x, o.y + trans(p()).y,
@@ -311,6 +414,7 @@ namespace wf {
 
         // Regenerate layout using a new size
         void decoration_layout_t::resize(int width, int height, wf::dimensions_t title_size, bool tiled_edges) {
+            phase_scope_t phase{PHASE_LAYOUT};
             max_height = std::max({ title_size.height, icon_size, button_size });
             this->background_areas.clear();
             this->layout_areas.clear();
@@ -358,30 +462,32 @@ namespace wf {
             // Resizing edges - right
             border_geometry = { width - right_resize, 0, right_resize, height };
             this->layout_areas.push_back(std::make_unique<decoration_area_t>(DECORATION_AREA_RESIZE_RIGHT, border_geometry, EDGE_RIGHT));
-        }
 
-        // @return The decoration areas which need to be rendered, in top to bottom
-        //  order.
+            hit_index.build(layout_areas);
 
-        std::vector<nonstd::observer_ptr<decoration_area_t>> decoration_layout_t::
-        get_renderable_areas() {
-            std::vector<nonstd::observer_ptr<decoration_area_t>> renderable;
+            renderable_list.clear();
             for (auto& area : layout_areas) {
                 if (area->get_type() & AREA_RENDERABLE_BIT) {
-                    renderable.push_back({area});
+                    renderable_list.push_back({area});
                 }
             }
 
-            return renderable;
-        }
-
-        std::vector<nonstd::observer_ptr<decoration_area_t>> decoration_layout_t::
-        get_background_areas() {
-            std::vector<nonstd::observer_ptr<decoration_area_t>> areas;
+            background_list.clear();
             for (auto& area : background_areas) {
-                areas.push_back({area});
+                background_list.push_back({area});
             }
-            return areas;
+        }
+
+        // @return The decoration areas which need to be rendered, in top to bottom
+        //  order.
+        const std::vector<nonstd::observer_ptr<decoration_area_t>>& decoration_layout_t::
+        get_renderable_areas() const {
+            return renderable_list;
+        }
+
+        const std::vector<nonstd::observer_ptr<decoration_area_t>>& decoration_layout_t::
+        get_background_areas() const {
+            return background_list;
         }
 
         wf::region_t decoration_layout_t::calculate_region() const {
@@ -480,43 +586,23 @@ namespace wf {
         // Find the layout area at the given coordinates, if any
         // @return The layout area or null on failure
         nonstd::observer_ptr<decoration_area_t> decoration_layout_t::find_area_at(wf::point_t point) {
-
-            // prioritize buttons
-            for (auto& area : this->layout_areas) {
-                if (area->get_type() == DECORATION_AREA_BUTTON && area->get_geometry() & point) {
-                    return {area};
-                }
-            }
-
-            for (auto& area : this->layout_areas) {
-                if (area->get_geometry() & point) {
-                    return {area};
-                }
-            }
-
-            return nullptr;
+            return hit_index.find(point);
         }
 
         // Calculate resize edges based on @current_input
         uint32_t decoration_layout_t::calculate_resize_edges() const {
-            uint32_t edges = 0;
-            for (auto& area : layout_areas) {
-                if (area->get_geometry() & this->current_input) {
-                    if (area->get_type() & AREA_RESIZE_BIT) {
-                        edges |= (area->get_type() & ~AREA_RESIZE_BIT);
-                    }
-                }
-            }
-
-            return edges;
+            return hit_index.get_resize_edges(current_input);
         }
 
-        // Update the cursor based on @current_input
-        void decoration_layout_t::update_cursor() const {
+        // Update the cursor based on @current_input, if it changed
+        void decoration_layout_t::update_cursor() {
             uint32_t edges   = calculate_resize_edges();
             auto cursor_name = edges > 0 ?
                 wlr_xcursor_get_resize_name((wlr_edges)edges) : "default";
-            wf::get_core().set_cursor(cursor_name);
+            if (current_cursor != cursor_name) {
+                current_cursor = cursor_name;
+                wf::get_core().set_cursor(cursor_name);
+            }
         }
 
         void decoration_layout_t::handle_focus_lost() {
@@ -529,6 +615,8 @@ namespace wf {
             }
 
             this->unset_hover(current_input);
+            /** Whatever the pointer moved onto sets its own cursor */
+            current_cursor.clear();
         }
     }
 }
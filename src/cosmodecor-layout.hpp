@@ -91,7 +91,7 @@ namespace wf {
             edge_t get_edge() const;
 
             /** @return The corners of the decoration area */
-            std::string get_corners() const;
+            const std::string& get_corners() const;
 
             /** @return The transformation matrix of the area */
             matrix<int> get_m() const;
@@ -136,6 +136,38 @@ namespace wf {
             border_size_t& operator =(const border_size_t& other) = default;
         };
 
+        /**
+         * Finds the layout area under a point in O(log n), for pointer events.
+         * The layout is cut into cells along every edge of its areas, each cell
+         * holding the area found there, with buttons over everything else, and the
+         * resize edges it lies on.
+         */
+        class hit_index_t {
+        public:
+            /** Index the areas, the first of overlapping areas being found first */
+            void build(const std::vector<std::unique_ptr<decoration_area_t>>& areas);
+
+            /** @return The area at the point, or null */
+            nonstd::observer_ptr<decoration_area_t> find(wf::point_t point) const;
+
+            /** @return The edges of the resize areas at the point */
+            uint32_t get_resize_edges(wf::point_t point) const;
+
+        private:
+            struct cell_t {
+                decoration_area_t *area = nullptr;
+                uint32_t edges = 0;
+            };
+
+            /** The edges of the areas, sorted, cell i spanning [xs[i], xs[i + 1]) */
+            std::vector<int> xs, ys;
+            /** Row major cells */
+            std::vector<cell_t> cells;
+
+            /** @return The cell holding the point, or null outside of every area */
+            const cell_t *cell_at(wf::point_t point) const;
+        };
+
         class decoration_theme_t;
         /**
          * Manages the layout of the decorations, i.e positioning of the title,
@@ -158,7 +190,7 @@ namespace wf {
             /**
              * Translate the border into four numbers, representing the top, left, bottom, and right border sizes, respectively.
              */
-            border_size_t parse_border(std::string border_size);
+            static border_size_t parse_border(std::string border_size);
 
             /** Create buttons in the layout, and return their total geometry */
             void create_areas(int width, int height, wf::dimensions_t title_size, bool tiled_edges);
@@ -168,13 +200,13 @@ namespace wf {
 
             /**
              * @return The decoration areas which need to be rendered, in top to bottom
-             *  order.
+             *  order, valid until the next resize.
              */
-            std::vector<nonstd::observer_ptr<decoration_area_t>> get_renderable_areas();
+            const std::vector<nonstd::observer_ptr<decoration_area_t>>& get_renderable_areas() const;
 
             /**
-             * @return The background areas of the decoration */
-            std::vector<nonstd::observer_ptr<decoration_area_t>> get_background_areas();
+             * @return The background areas of the decoration, valid until the next resize */
+            const std::vector<nonstd::observer_ptr<decoration_area_t>>& get_background_areas() const;
 
             /** @return The combined region of all layout areas */
             wf::region_t calculate_region() const;
@@ -211,6 +243,7 @@ namespace wf {
             const int button_size;
             const int icon_size;
             const int padding_size;
+            const int max_title_size;
 
             const decoration_theme_t& theme;
 
@@ -222,6 +255,11 @@ namespace wf {
 
             std::vector<std::unique_ptr<decoration_area_t>> background_areas;
 
+            /** Built along with the areas, for pointer events */
+            hit_index_t hit_index;
+            /** Built along with the areas, so that drawing never has to */
+            std::vector<nonstd::observer_ptr<decoration_area_t>> renderable_list, background_list;
+
             bool is_grabbed = false;
             /* Position where the grab has started */
             wf::point_t grab_origin;
@@ -230,11 +268,13 @@ namespace wf {
             /* double-click timer */
             wf::wl_timer<false> timer;
             bool double_click_at_release = false;
+            /** The cursor last set, empty once the pointer has left */
+            std::string current_cursor;
 
             /** Calculate resize edges based on @current_input */
             uint32_t calculate_resize_edges() const;
-            /** Update the cursor based on @current_input */
-            void update_cursor() const;
+            /** Update the cursor based on @current_input, if it changed */
+            void update_cursor();
 
             /**
              * Find the layout area at the given coordinates, if any
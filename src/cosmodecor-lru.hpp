@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+namespace wf {
+    namespace cosmodecor {
+        /**
+         * A map holding at most a fixed number of values, dropping the least
+         * recently used one to make room for new ones.
+         */
+        template<typename Key, typename Value>
+        class lru_cache_t {
+        public:
+            /** @param capacity The number of values to keep, at least one */
+            explicit lru_cache_t(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+            /** @return The value for the key, now the most recently used one, or null */
+            Value *get(const Key& key) {
+                auto it = index.find(key);
+                if (it == index.end()) {
+                    return nullptr;
+                }
+
+                entries.splice(entries.begin(), entries, it->second);
+                return &it->second->second;
+            }
+
+            /**
+             * Insert or replace the value for the key, evicting the least recently
+             * used value if the cache is full.
+             * @return The value, as stored in the cache.
+             */
+            Value& put(const Key& key, Value value) {
+                auto it = index.find(key);
+                if (it != index.end()) {
+                    it->second->second = std::move(value);
+                    entries.splice(entries.begin(), entries, it->second);
+                    return it->second->second;
+                }
+
+                if (entries.size() >= capacity) {
+                    index.erase(entries.back().first);
+                    entries.pop_back();
+                }
+
+                entries.emplace_front(key, std::move(value));
+                index.emplace(key, entries.begin());
+                return entries.front().second;
+            }
+
+            /** Remove the value for the key, if any */
+            void erase(const Key& key) {
+                auto it = index.find(key);
+                if (it != index.end()) {
+                    entries.erase(it->second);
+                    index.erase(it);
+                }
+            }
+
+            /** Call a function with every value, most recently used first */
+            template<typename Function>
+            void for_each(Function function) const {
+                for (const auto& entry : entries) {
+                    function(entry.second);
+                }
+            }
+
+            void clear() {
+                index.clear();
+                entries.clear();
+            }
+
+            size_t size() const {
+                return entries.size();
+            }
+
+        private:
+            size_t capacity;
+            /** Most recently used first */
+            std::list<std::pair<Key, Value>> entries;
+            std::map<Key, typename std::list<std::pair<Key, Value>>::iterator> index;
+        };
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <wayfire/toplevel.hpp>
+
+namespace wf {
+    namespace cosmodecor {
+        /**
+         * The margins of a decorated toplevel for a state, computed again only
+         * when the border, the kind of state, or maximized_titlebar changed since
+         * the last call. The transaction hook asks for them for every decorated
+         * object of every transaction.
+         */
+        class margins_cache_t {
+        public:
+            /**
+             * @param border The border of the decoration.
+             * @param border_serial Changes whenever the border does.
+             */
+            const wf::decoration_margins_t& get(const wf::toplevel_state_t& state, bool maximized_titlebar,
+                                                const wf::decoration_margins_t& border, uint64_t border_serial) {
+                bool tiled = (state.tiled_edges != 0);
+                if (valid && (fullscreen == state.fullscreen) && (this->tiled == tiled) &&
+                    (this->maximized_titlebar == maximized_titlebar) && (this->border_serial == border_serial)) {
+                    return margins;
+                }
+
+                valid = true;
+                fullscreen = state.fullscreen;
+                this->tiled = tiled;
+                this->maximized_titlebar = maximized_titlebar;
+                this->border_serial = border_serial;
+
+                if (state.fullscreen || (!maximized_titlebar && tiled)) {
+                    margins = {0, 0, 0, 0};
+                } else {
+                    margins = border;
+                }
+
+                return margins;
+            }
+
+        private:
+            bool valid = false;
+            bool fullscreen, tiled, maximized_titlebar;
+            uint64_t border_serial;
+            wf::decoration_margins_t margins;
+        };
+    }
+}
@@ -0,0 +1,123 @@
+#include <wayfire/debug.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/option-wrapper.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "cosmodecor-memory.hpp"
+
+namespace wf {
+    namespace cosmodecor {
+        /** The budget, in MiB, 0 for none */
+        static wf::option_wrapper_t<int> memory_budget{"cosmodecor/memory_budget"};
+        static wf::option_wrapper_t<bool> debug_mode{"cosmodecor/debug_mode"};
+
+        static constexpr int64_t MIB = 1024 * 1024;
+        /** The change in usage worth logging in debug mode */
+        static constexpr int64_t LOG_STEP = 4 * MIB;
+        /** Clients drawn this recently are kept, they would only be built again right away */
+        static constexpr uint32_t EVICT_AFTER = 1000;
+
+        static const char *kind_names[MEMORY_KIND_COUNT] = {
+            "atlas", "atlas slots", "bakes"
+        };
+
+        static std::string mib(int64_t bytes) {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2) << (double)bytes / MIB << "MiB";
+            return out.str();
+        }
+
+        memory_ledger_t& memory_ledger_t::get() {
+            static memory_ledger_t ledger;
+            return ledger;
+        }
+
+        void memory_ledger_t::add(memory_kind_t kind, int64_t bytes) {
+            usage[kind] += bytes;
+
+            if ((bytes > 0) && (memory_budget > 0) && (get_reclaimable() > memory_budget * MIB)) {
+                idle_enforce.run_once([this] () { enforce(); });
+            }
+
+            int64_t total = get_total();
+            if (debug_mode && (total / LOG_STEP != logged_step)) {
+                logged_step = total / LOG_STEP;
+                log();
+            }
+        }
+
+        int64_t memory_ledger_t::get_usage(memory_kind_t kind) const {
+            return usage[kind];
+        }
+
+        int64_t memory_ledger_t::get_total() const {
+            int64_t total = 0;
+            for (int i = 0; i < MEMORY_KIND_COUNT; i++) {
+                /** Slots are part of the pages, counted once */
+                total += (i == MEMORY_ATLAS_SLOTS) ? 0 : usage[i];
+            }
+
+            return total;
+        }
+
+        int64_t memory_ledger_t::get_reclaimable() const {
+            return usage[MEMORY_ATLAS_SLOTS] + usage[MEMORY_BAKES];
+        }
+
+        void memory_ledger_t::add_client(memory_client_t *client) {
+            clients.push_back(client);
+        }
+
+        void memory_ledger_t::remove_client(memory_client_t *client) {
+            clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+        }
+
+        void memory_ledger_t::enforce() {
+            int64_t budget = (int64_t)memory_budget * MIB;
+            if ((budget <= 0) || (get_reclaimable() <= budget)) {
+                return;
+            }
+
+            std::vector<memory_client_t*> candidates = clients;
+            std::sort(candidates.begin(), candidates.end(), [] (auto a, auto b) {
+                return a->get_last_drawn() < b->get_last_drawn();
+            });
+
+            uint32_t now = wf::get_current_time();
+            size_t evicted = 0;
+            for (auto client : candidates) {
+                if ((get_reclaimable() <= budget) || (now - client->get_last_drawn() < EVICT_AFTER)) {
+                    break;
+                }
+
+                client->evict_memory();
+                evicted++;
+            }
+
+            LOGD("cosmodecor memory over its budget of ", mib(budget), ", evicted ", evicted,
+                 " decorations, now at ", mib(get_reclaimable()), " of ", mib(get_total()));
+        }
+
+        void memory_ledger_t::log() const {
+            std::ostringstream line;
+            line << mib(get_total()) << " in total, " << mib(get_reclaimable()) << " reclaimable;";
+            for (int i = 0; i < MEMORY_KIND_COUNT; i++) {
+                line << " " << kind_names[i] << " " << mib(usage[i]);
+            }
+
+            int64_t largest = 0, views = 0;
+            for (auto client : clients) {
+                int64_t bytes = client->get_memory_usage();
+                largest = std::max(largest, bytes);
+                views  += bytes;
+            }
+
+            line << "; " << clients.size() << " decorations hold " << mib(views);
+            line << ", at most " << mib(largest) << " each";
+            LOGI("cosmodecor memory, ", line.str());
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <wayfire/util.hpp>
+
+namespace wf {
+    namespace cosmodecor {
+        /** What the memory of decorations is spent on */
+        enum memory_kind_t {
+            /** GL atlas pages, holding titles, icons and buttons */
+            MEMORY_ATLAS,
+            /** The part of the atlas pages taken by slots, freed along with them */
+            MEMORY_ATLAS_SLOTS,
+            /** GL framebuffers of baked idle decorations */
+            MEMORY_BAKES,
+            MEMORY_KIND_COUNT
+        };
+
+        /** Holds memory which it can give back, and rebuild when drawn again */
+        class memory_client_t {
+        public:
+            virtual ~memory_client_t() = default;
+
+            /** @return When the client was last drawn, in ms */
+            virtual uint32_t get_last_drawn() const = 0;
+
+            /** @return The bytes held by the client, shared assets excluded */
+            virtual int64_t get_memory_usage() const = 0;
+
+            /** Drop everything that can be built again on the next draw */
+            virtual void evict_memory() = 0;
+        };
+
+        /**
+         * Counts the bytes held by decorations, per kind, and keeps the ones which
+         * evictions can free under the memory_budget option, by evicting the least
+         * recently drawn clients first, once the main loop goes idle. Whole atlas
+         * pages are not budgeted, the last ones of each output stay even when empty.
+         *
+         * In debug mode, the usage is logged whenever it changes by a few MiB.
+         */
+        class memory_ledger_t {
+        public:
+            static memory_ledger_t& get();
+
+            /** Count bytes allocated, or freed when negative */
+            void add(memory_kind_t kind, int64_t bytes);
+
+            /** @return The bytes held, of one kind or in total */
+            int64_t get_usage(memory_kind_t kind) const;
+            int64_t get_total() const;
+
+            /** @return The bytes evicting clients can free, compared to the budget */
+            int64_t get_reclaimable() const;
+
+            void add_client(memory_client_t *client);
+            void remove_client(memory_client_t *client);
+
+            /** Log the usage per kind and per client */
+            void log() const;
+
+        private:
+            int64_t usage[MEMORY_KIND_COUNT] = {};
+            std::vector<memory_client_t*> clients;
+            wf::wl_idle_call idle_enforce;
+            /** The usage last logged, in steps of LOG_STEP */
+            int64_t logged_step = 0;
+
+            /** Evict until the usage fits the budget */
+            void enforce();
+        };
+    }
+}
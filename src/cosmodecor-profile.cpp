@@ -0,0 +1,186 @@
+#include <wayfire/debug.hpp>
+#include <wayfire/util.hpp>
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "cosmodecor-profile.hpp"
+
+namespace wf {
+    namespace cosmodecor {
+        static const char *subsystem_names[PROFILE_SUBSYSTEM_COUNT] = {
+            "options", "layout", "rsvg", "pango", "gsettings", "cairo", "upload"
+        };
+
+        static const char *phase_names[PROFILE_PHASE_COUNT] = {
+            "layout", "text_size", "form_title", "form_button", "form_icon",
+            "upload", "build_plan", "bake", "submit"
+        };
+
+        static const char *counter_names[PROFILE_COUNTER_COUNT] = {
+            "uploaded_bytes", "slots_created", "pages_created", "bakes"
+        };
+
+        /** How often the phase histograms are logged, in ms */
+        static constexpr int PHASE_DUMP_INTERVAL = 10000;
+        static wf::wl_timer<false> phase_dump_timer;
+
+        startup_profile_t& startup_profile_t::get() {
+            static startup_profile_t profile;
+            return profile;
+        }
+
+        void startup_profile_t::begin() {
+            phase = PHASE_INIT;
+            views = renders = 0;
+            end_scheduled = false;
+            for (int p : { PHASE_INIT, PHASE_FIRST_FRAME }) {
+                totals[p] = std::chrono::nanoseconds{0};
+                for (auto& sample : samples[p]) {
+                    sample = std::chrono::nanoseconds{0};
+                }
+            }
+
+            start = std::chrono::steady_clock::now();
+        }
+
+        void startup_profile_t::add(profile_subsystem_t subsystem, std::chrono::nanoseconds time) {
+            if (phase != PHASE_DONE) {
+                samples[phase][subsystem] += time;
+            }
+        }
+
+        void startup_profile_t::end_init(size_t views) {
+            if (phase != PHASE_INIT) {
+                return;
+            }
+
+            this->views = views;
+            totals[PHASE_INIT] = std::chrono::steady_clock::now() - start;
+            phase = PHASE_FIRST_FRAME;
+        }
+
+        void startup_profile_t::begin_render() {
+            if (phase == PHASE_FIRST_FRAME) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        void startup_profile_t::end_render() {
+            if (phase != PHASE_FIRST_FRAME) {
+                return;
+            }
+
+            totals[PHASE_FIRST_FRAME] += std::chrono::steady_clock::now() - start;
+            renders++;
+
+            /** Every decoration of the first frame is drawn before the loop goes idle */
+            if (!end_scheduled) {
+                end_scheduled = true;
+                static wf::wl_idle_call idle_finish;
+                idle_finish.run_once([this] () { finish(); });
+            }
+        }
+
+        void startup_profile_t::finish() {
+            auto ms = [] (std::chrono::nanoseconds time) {
+                std::ostringstream out;
+                out << std::fixed << std::setprecision(3) << time.count() / 1e6 << "ms";
+                return out.str();
+            };
+
+            for (int p : { PHASE_INIT, PHASE_FIRST_FRAME }) {
+                std::ostringstream line;
+                line << ((p == PHASE_INIT) ? "init(): " : "first frame: ") << ms(totals[p]);
+                line << ((p == PHASE_INIT) ? " for " : " over ");
+                line << ((p == PHASE_INIT) ? views : renders) << " decorations;";
+                for (int i = 0; i < PROFILE_SUBSYSTEM_COUNT; i++) {
+                    line << " " << subsystem_names[i] << " " << ms(samples[p][i]);
+                }
+
+                LOGI("cosmodecor startup profile, ", line.str());
+            }
+
+            phase = PHASE_DONE;
+        }
+
+        phase_profile_t& phase_profile_t::get() {
+            static phase_profile_t profile;
+            return profile;
+        }
+
+        void phase_profile_t::set_enabled(bool enabled) {
+            reset();
+            is_enabled = enabled;
+            if (!enabled) {
+                phase_dump_timer.disconnect();
+            } else if (!phase_dump_timer.is_connected()) {
+                phase_dump_timer.set_timeout(PHASE_DUMP_INTERVAL, [this] () { dump(); });
+            }
+        }
+
+        void phase_profile_t::reset() {
+            for (auto& histogram : histograms) {
+                histogram = {};
+            }
+
+            for (auto& counter : counters) {
+                counter = 0;
+            }
+        }
+
+        void phase_profile_t::add(profile_phase_t phase, std::chrono::nanoseconds time) {
+            auto& histogram = histograms[phase];
+            histogram.count++;
+            histogram.total += time;
+            histogram.max = std::max(histogram.max, time);
+
+            /** Bucket i holds samples under 2^(i + 1)µs, the last one everything longer */
+            uint64_t us = time.count() / 1000;
+            int bucket = 0;
+            while ((us >>= 1) && (bucket < BUCKETS - 1)) {
+                bucket++;
+            }
+
+            histogram.buckets[bucket]++;
+        }
+
+        void phase_profile_t::dump() {
+            auto us = [] (double ns) {
+                std::ostringstream out;
+                out << std::fixed << std::setprecision(1) << ns / 1e3 << "us";
+                return out.str();
+            };
+
+            for (int p = 0; p < PROFILE_PHASE_COUNT; p++) {
+                const auto& histogram = histograms[p];
+                if (histogram.count == 0) {
+                    continue;
+                }
+
+                std::ostringstream line;
+                line << phase_names[p] << ": " << histogram.count << " calls, mean ";
+                line << us((double)histogram.total.count() / histogram.count);
+                line << ", max " << us(histogram.max.count()) << ";";
+                for (int i = 0; i < BUCKETS; i++) {
+                    if (histogram.buckets[i] > 0) {
+                        line << " <" << (2 << i) << "us:" << histogram.buckets[i];
+                    }
+                }
+
+                LOGI("cosmodecor phases, ", line.str());
+            }
+
+            std::ostringstream line;
+            for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+                line << " " << counter_names[c] << " " << counters[c];
+            }
+
+            LOGI("cosmodecor counters,", line.str());
+
+            reset();
+            phase_dump_timer.set_timeout(PHASE_DUMP_INTERVAL, [this] () { dump(); });
+        }
+    }
+}
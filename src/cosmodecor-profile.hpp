@@ -0,0 +1,194 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace wf {
+    namespace cosmodecor {
+        /** The subsystems whose startup cost is tracked */
+        enum profile_subsystem_t {
+            PROFILE_OPTIONS,
+            PROFILE_LAYOUT,
+            PROFILE_RSVG,
+            PROFILE_PANGO,
+            PROFILE_GSETTINGS,
+            PROFILE_CAIRO,
+            PROFILE_UPLOAD,
+            PROFILE_SUBSYSTEM_COUNT
+        };
+
+        /**
+         * Collects the time spent per subsystem during the plugin's init() and
+         * the first decorated frame, and logs it once the first frame is done.
+         * Only active in debug mode, otherwise every call is a single branch.
+         */
+        class startup_profile_t {
+        public:
+            static startup_profile_t& get();
+
+            /** Start collecting samples for init() */
+            void begin();
+
+            /** @return Whether samples are being collected */
+            bool active() const {
+                return phase != PHASE_DONE;
+            }
+
+            /** Add the time spent in a subsystem to the current phase */
+            void add(profile_subsystem_t subsystem, std::chrono::nanoseconds time);
+
+            /**
+             * Close the init() phase.
+             * @param views The number of views decorated during init().
+             */
+            void end_init(size_t views);
+
+            /** Mark the start and end of a decoration's render in the first frame */
+            void begin_render();
+            void end_render();
+
+        private:
+            enum phase_t {
+                PHASE_INIT        = 0,
+                PHASE_FIRST_FRAME = 1,
+                PHASE_DONE        = 2
+            };
+
+            phase_t phase = PHASE_DONE;
+            size_t views  = 0;
+            size_t renders = 0;
+            bool end_scheduled = false;
+
+            std::chrono::steady_clock::time_point start;
+            std::chrono::nanoseconds totals[2];
+            std::chrono::nanoseconds samples[2][PROFILE_SUBSYSTEM_COUNT];
+
+            /** Log the whole profile and stop collecting */
+            void finish();
+        };
+
+        /** The hot paths timed while debug_mode is on */
+        enum profile_phase_t {
+            PHASE_LAYOUT,
+            PHASE_TEXT_SIZE,
+            PHASE_FORM_TITLE,
+            PHASE_FORM_BUTTON,
+            PHASE_FORM_ICON,
+            PHASE_UPLOAD,
+            PHASE_BUILD_PLAN,
+            PHASE_BAKE,
+            PHASE_SUBMIT,
+            PROFILE_PHASE_COUNT
+        };
+
+        /** Events counted along with the phases */
+        enum profile_counter_t {
+            COUNTER_UPLOADED_BYTES,
+            COUNTER_SLOTS_CREATED,
+            COUNTER_PAGES_CREATED,
+            COUNTER_BAKES,
+            PROFILE_COUNTER_COUNT
+        };
+
+        /**
+         * Latency histograms of the hot paths and a few counters, collected while
+         * debug_mode is on and logged every few seconds. Histogram buckets are
+         * powers of two, from 1µs up.
+         *
+         * While it is off, a timed scope costs a single load and branch.
+         */
+        class phase_profile_t {
+        public:
+            static constexpr int BUCKETS = 16;
+
+            static phase_profile_t& get();
+
+            /** @return Whether phases are timed */
+            static bool enabled() {
+                return is_enabled;
+            }
+
+            /** Start or stop timing, dropping everything collected so far */
+            void set_enabled(bool enabled);
+
+            /** Add a sample to the histogram of a phase */
+            void add(profile_phase_t phase, std::chrono::nanoseconds time);
+
+            /** Add to a counter, if phases are timed */
+            static void count(profile_counter_t counter, int64_t amount = 1) {
+                if (is_enabled) {
+                    get().counters[counter] += amount;
+                }
+            }
+
+        private:
+            static inline bool is_enabled = false;
+
+            struct histogram_t {
+                uint64_t count;
+                std::chrono::nanoseconds total, max;
+                uint64_t buckets[BUCKETS];
+            };
+
+            histogram_t histograms[PROFILE_PHASE_COUNT];
+            int64_t counters[PROFILE_COUNTER_COUNT];
+
+            void reset();
+            /** Log every phase which ran since the last dump, then start over */
+            void dump();
+        };
+
+        /** Adds the time spent in its scope to the histogram of a phase */
+        class phase_scope_t {
+        public:
+            phase_scope_t(profile_phase_t phase) :
+                phase(phase),
+                enabled(phase_profile_t::enabled()) {
+                if (enabled) {
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+
+            ~phase_scope_t() {
+                if (enabled) {
+                    phase_profile_t::get().add(phase, std::chrono::steady_clock::now() - start);
+                }
+            }
+
+            phase_scope_t(const phase_scope_t &) = delete;
+            phase_scope_t& operator =(const phase_scope_t&) = delete;
+
+        private:
+            profile_phase_t phase;
+            bool enabled;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        /** Adds the time spent in its scope to a subsystem of the startup profile */
+        class profile_scope_t {
+        public:
+            profile_scope_t(profile_subsystem_t subsystem) :
+                subsystem(subsystem),
+                enabled(startup_profile_t::get().active()) {
+                if (enabled) {
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+
+            ~profile_scope_t() {
+                if (enabled) {
+                    startup_profile_t::get().add(subsystem, std::chrono::steady_clock::now() - start);
+                }
+            }
+
+            profile_scope_t(const profile_scope_t &) = delete;
+            profile_scope_t& operator =(const profile_scope_t&) = delete;
+
+        private:
+            profile_subsystem_t subsystem;
+            bool enabled;
+            std::chrono::steady_clock::time_point start;
+        };
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+
+namespace wf {
+    namespace cosmodecor {
+        /**
+         * Maps objects to what cosmodecor attached to them, by address, for hot
+         * paths which can't afford a dynamic cast and a lookup by type name for
+         * every object they see. Values must remove themselves before they, or
+         * their objects, go away. A value may replace another on the same object
+         * before the old one is gone, so removing only ever erases its own entry.
+         */
+        template<typename Object, typename Value>
+        class pointer_registry_t {
+        public:
+            void add(const Object *object, Value *value) {
+                entries[object] = value;
+            }
+
+            /** Detach the value from the object, unless another value replaced it since */
+            void remove(const Object *object, const Value *value) {
+                auto it = entries.find(object);
+                if ((it != entries.end()) && (it->second == value)) {
+                    entries.erase(it);
+                }
+            }
+
+            /** @return The value attached to the object, or null */
+            Value *find(const Object *object) const {
+                auto it = entries.find(object);
+                return (it == entries.end()) ? nullptr : it->second;
+            }
+
+            size_t size() const {
+                return entries.size();
+            }
+
+        private:
+            std::unordered_map<const Object*, Value*> entries;
+        };
+    }
+}
@@ -4,6 +4,7 @@
 
 #include <wayfire/nonstd/wlroots.hpp>
 #include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
 #include <wayfire/opengl.hpp>
 #include <wayfire/core.hpp>
 #include <wayfire/view-transform.hpp>
@@ -17,6 +18,11 @@
 #include "cosmodecor-layout.hpp"
 #include "cosmodecor-theme.hpp"
 #include "cosmodecor-subsurface.hpp"
+#include "cosmodecor-profile.hpp"
+#include "cosmodecor-draw-list.hpp"
+#include "cosmodecor-lru.hpp"
+#include "cosmodecor-memory.hpp"
+#include "cosmodecor-alloc-check.hpp"
 
 #include "cairo-simpler.hpp"
 //#include "cairo-util.hpp"
@@ -31,183 +37,417 @@
 
 namespace wf::cosmodecor {
 wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
+wf::option_wrapper_t<std::string> default_border_size{"cosmodecor/border_size"};
+wf::option_wrapper_t<bool> bake_idle{"cosmodecor/bake_idle"};
+wf::option_wrapper_t<int> inactive_title_interval{"cosmodecor/inactive_title_interval"};
 
-    class simple_decoration_node_t : public wf::scene::node_t, public wf::pointer_interaction_t, public wf::touch_interaction_t
+    class simple_decoration_node_t : public wf::scene::node_t, public wf::pointer_interaction_t, public wf::touch_interaction_t,
+                                     public memory_client_t
     {
         std::weak_ptr<wf::toplevel_view_interface_t> _view;
 
         wf::signal::connection_t<wf::view_title_changed_signal> title_set = [=, this] (wf::view_title_changed_signal *ev) {
+            schedule_title_change();
+        };
+
+        /** Flags the app id as changed, so that frames never copy it to compare */
+        wf::signal::connection_t<wf::view_app_id_changed_signal> app_id_set = [this] (wf::view_app_id_changed_signal*) {
+            icon.app_id_changed = true;
+        };
+
+        /** Applies the pending title change right before the output's next frame */
+        wf::effect_hook_t pre_frame_title = [=, this] () {
+            apply_title_change();
+        };
+
+        /** The output pre_frame_title is hooked to, if any */
+        wf::output_t *title_hook_output = nullptr;
+
+        /** The hooked output going away would leave the title frozen, it is applied right away instead */
+        wf::signal::connection_t<wf::output_pre_remove_signal> on_output_removed =
+            [this] (wf::output_pre_remove_signal *ev) {
+                if (ev->output == title_hook_output) {
+                    apply_title_change();
+                }
+            };
+
+        /** A pending title follows the view to its new output */
+        wf::signal::connection_t<wf::view_set_output_signal> on_set_output = [this] (wf::view_set_output_signal*) {
+            auto view = _view.lock();
+            if (title_hook_output && (!view || (view->get_output() != title_hook_output))) {
+                unhook_title_change();
+                hook_title_change();
+            }
+        };
+        wf::wl_timer<false> title_timer;
+        uint32_t last_title_change = 0;
+
+        /**
+         * Coalesce title changes: the latest title is laid out once, on the next
+         * frame. Inactive views wait for inactive_title_interval since the last
+         * change they applied.
+         */
+        void schedule_title_change() {
+            if (title_hook_output || title_timer.is_connected()) {
+                return;
+            }
+
             if (auto view = _view.lock()) {
+                int since = wf::get_current_time() - last_title_change;
+                int wait  = view->activated ? 0 : inactive_title_interval - since;
+                if (wait > 0) {
+                    title_timer.set_timeout(wait, [=, this] () { hook_title_change(); });
+                } else {
+                    hook_title_change();
+                }
+            }
+        }
+
+        void hook_title_change() {
+            if (auto view = _view.lock()) {
+                if (auto output = view->get_output()) {
+                    title_hook_output = output;
+                    output->render->add_effect(&pre_frame_title, wf::OUTPUT_EFFECT_PRE);
+                    output->render->schedule_redraw();
+                    wf::get_core().output_layout->connect(&on_output_removed);
+                } else {
+                    apply_title_change();
+                }
+            }
+        }
+
+        void unhook_title_change() {
+            if (title_hook_output) {
+                title_hook_output->render->rem_effect(&pre_frame_title);
+                title_hook_output = nullptr;
+                on_output_removed.disconnect();
+            }
+        }
+
+        void apply_title_change() {
+            unhook_title_change();
+            last_title_change = wf::get_current_time();
+            if (auto view = _view.lock()) {
+                /** Lay the title out right away, so that only what moved gets damaged */
+                auto before = renderable_geometries();
                 title_changed = true;
-                view->damage(); // trigger re-render
+                update_layout(DONT_FORCE, last_scale);
+                auto after = renderable_geometries();
+
+                region_t damage;
+                for (size_t i = 0; i < std::max(before.size(), after.size()); i++) {
+                    bool changed = (i >= before.size()) || (i >= after.size()) ||
+                                   (before[i].first == DECORATION_AREA_TITLE) ||
+                                   (before[i].second != after[i].second);
+                    if (changed && (i < before.size())) {
+                        damage |= before[i].second;
+                    }
+
+                    if (changed && (i < after.size())) {
+                        damage |= after[i].second;
+                    }
+                }
+
+                damage_local(damage);
             }
         };
 
+        /** @return The type and geometry of the title, icon and buttons */
+        std::vector<std::pair<decoration_area_type_t, geometry_t>> renderable_geometries() {
+            std::vector<std::pair<decoration_area_type_t, geometry_t>> geometries;
+            for (auto area : layout.get_renderable_areas()) {
+                geometries.push_back({ area->get_type(), area->get_geometry() });
+            }
+
+            return geometries;
+        }
+
+        /** Damage part of the decoration, given relative to its top left corner */
+        void damage_local(const region_t& region) {
+            wf::scene::damage_node(shared_from_this(), region + get_offset());
+        }
+
+        /** The scale of the last render, to lay titles out between frames */
+        double last_scale = 1.0;
+
+        /** Rasterized assets kept per view, one per scale it was recently drawn at */
+        static constexpr size_t SCALE_VARIANTS = 3;
+
+        /** Rasterize the title as a mask for the scale, which serves both activation states */
         void update_title(double scale) {
+            if (title.stale) {
+                title.masks.clear();
+                title.stale = false;
+            }
+
+            /** Switching between cached scales changes nothing drawn at either of them */
+            if (auto mask = title.masks.get(scale)) {
+                title.mask = *mask;
+                return;
+            }
+
             if (auto view = _view.lock()) {
+                /** Only the part of the title which fits in its area is rasterized */
                 dimensions_t title_size = {
-                    (int)(title.dims.width * scale), (int)(title.dims.height * scale)
+                    (int)(title.area.width * scale), (int)(title.area.height * scale)
                 };
 
-                auto o = HORIZONTAL;
-                std::string text = title.text;
-                int count = 0;
-                wf::dimensions_t size = title_size;
-
-                for (auto texture : { title.hor }) {
-                    for (auto state : { ACTIVE, INACTIVE }) {
-                        cairo_surface_t *surface;
-                        surface = theme.form_title(text, size, state, o, scale);
-                        cairo_surface_upload_to_texture(surface, texture[state]);
-                        cairo_surface_destroy(surface);
-                    }
+                atlas_handle_t mask;
+                cairo_surface_t *surface = theme.form_title(title.text, title_size, HORIZONTAL, scale);
+                atlas->upload(surface, mask);
+                cairo_surface_destroy(surface);
+                title.mask = title.masks.put(scale, mask);
+                content_serial++;
+            }
+        }
 
-                    count++;
-                };
-                title_needs_update = false;
+        /** Bakes of the state not shown for this long are dropped, in ms */
+        static constexpr int UNUSED_STATE_TIMEOUT = 5000;
+        wf::wl_timer<false> unused_state_timer;
+
+        /** Drop the bake of the activation state not shown */
+        void drop_unused_state() {
+            if (auto view = _view.lock()) {
+                release_bake(bakes[!view->activated]);
             }
         }
 
         void update_icon(double scale) {
-            if (auto view = _view.lock()) {
-                if (view->get_app_id() != icon.app_id) {
-                    icon.app_id = view->get_app_id();
-                    auto surface = theme.form_icon(icon.app_id, scale);
-                    cairo_surface_upload_to_texture(surface, icon.texture);
-                    cairo_surface_destroy(surface);
+            if (icon.app_id_changed) {
+                if (auto view = _view.lock()) {
+                    icon.app_id_changed = false;
+                    if (view->get_app_id() != icon.app_id) {
+                        icon.app_id = view->get_app_id();
+                        icon.textures.clear();
+                    }
                 }
             }
+
+            if (auto texture = icon.textures.get(scale)) {
+                icon.texture = *texture;
+                return;
+            }
+
+            atlas_handle_t texture;
+            auto surface = theme.form_icon(icon.app_id, scale);
+            atlas->upload(surface, texture);
+            cairo_surface_destroy(surface);
+            icon.texture = icon.textures.put(scale, texture);
+            content_serial++;
         }
 
         void update_layout(bool force, double scale) {
+            /** The mask is tinted when drawn, new colors only need a new plan */
+            if (title.colors != theme.get_title_colors()) {
+                title.colors = theme.get_title_colors();
+                plan.clear();
+            }
+
+            if (!title_changed && !force) {
+                return;
+            }
+
             if (auto view = _view.lock()) {
-                if ((title.colors != theme.get_title_colors()) || title_changed || force) {
-                    // Update cached variables
-                    title.colors = theme.get_title_colors();
-                    title.text = view->get_title();
+                // Update cached variables
+                title.text = view->get_title();
 
-                    wf::dimensions_t cur_size = theme.get_text_size(title.text, size.width, scale);
+                /** Layouts without a title never need the font machinery */
+                wf::dimensions_t cur_size = has_title ?
+                    theme.get_text_size(title.text, scale) : wf::dimensions_t{0, 0};
 
-                    title.dims.height = cur_size.height;
-                    title.dims.width = cur_size.width;
+                title.dims.height = cur_size.height;
+                title.dims.width = cur_size.width;
 
-                    title_changed = false;
-                    title_needs_update = true;
+                title_changed = false;
+                title.stale = true;
 
-                    // Necessary in order to immediately place areas correctly
-                    layout.resize(size.width, size.height, title.dims, view->toplevel()->current().tiled_edges);
-                }
+                // Necessary in order to immediately place areas correctly
+                profile_scope_t profile{PROFILE_LAYOUT};
+                layout.resize(size.width, size.height, title.dims, view->toplevel()->current().tiled_edges);
+                update_title_area();
+                plan.clear();
             }
         }
 
         // Title variables
         struct {
-            simple_texture_t hor[2];
+            /** The coverage of the text at the scale being drawn, in the title colors */
+            atlas_handle_t mask;
+            /** The masks of the scales the title was recently drawn at */
+            lru_cache_t<double, atlas_handle_t> masks{SCALE_VARIANTS};
             std::string text = "";
             color_set_t colors;
+            /** The size of the whole text */
             dimensions_t dims;
+            /** Where the layout placed the title, ellipsized if it had to be */
+            geometry_t area = { 0, 0, 0, 0 };
+            /** Whether the masks are out of date */
+            bool stale = true;
         } title;
 
-        bool title_needs_update = false;
+        /** Find the title's area, and rasterize the title again if its size changed */
+        void update_title_area() {
+            geometry_t area = { 0, 0, 0, 0 };
+            for (auto item : layout.get_renderable_areas()) {
+                if (item->get_type() == DECORATION_AREA_TITLE) {
+                    area = item->get_geometry();
+                }
+            }
+
+            if ((area.width != title.area.width) || (area.height != title.area.height)) {
+                title.stale = true;
+            }
+
+            title.area = area;
+        }
+
         bool title_changed = true;
+        /** Whether the layout places a title at all */
+        bool has_title;
 
         // Icon variables
         struct {
-            simple_texture_t texture;
+            /** The icon at the scale being drawn */
+            atlas_handle_t texture;
+            lru_cache_t<double, atlas_handle_t> textures{SCALE_VARIANTS};
             std::string app_id = "";
+            /** Whether the app id may differ from app_id */
+            bool app_id_changed = true;
         } icon;
 
 
         // Corner Varibles
-        struct corner_texture_t {
-            simple_texture_t tex[2];
-            cairo_surface_t *surf[2];
+        struct corner_t {
             geometry_t g;
             int r;
         };
 
         struct {
-            corner_texture_t tr, tl, bl, br;
+            corner_t tr, tl, bl, br;
         } corners;
 
-        // Edge variables
-        struct edge_colors_t {
-            color_set_t border, outline;
-        } edges;
+        /** What to draw, rebuilt only when the layout changes */
+        render_plan_t plan;
+        bool plan_has_icon = false;
+
+        /** Every quad of the decoration, submitted in one pass per frame */
+        draw_list_t draw_list;
+
+        /** The atlas of the view's output, which new textures are uploaded to */
+        std::shared_ptr<texture_atlas_t> atlas;
+        wf::output_t *atlas_output = nullptr;
+
+        /** Renders without any change, before the frame gets baked */
+        static constexpr int BAKE_AFTER_FRAMES = 2;
+
+        /**
+         * The whole frame, baked per activation state into a texture holding its
+         * top and bottom rows, then its left and right columns.
+         */
+        struct bake_t {
+            wf::framebuffer_t fb;
+            /** The content serial and scale of the bake, serial 0 was never baked */
+            uint64_t serial = 0;
+            double scale = 0;
+            /** When the bake was last drawn */
+            uint32_t drawn_at = 0;
+            /** The GL memory of the framebuffer */
+            int64_t bytes = 0;
+        } bakes[2];
+
+        /**
+         * A bake drawn this recently is not rebaked for another scale, the view is
+         * likely shown on several outputs and the bake would flip on every frame.
+         */
+        static constexpr uint32_t BAKE_SCALE_GRACE = 1000;
+
+        void release_bake(bake_t& bake) {
+            OpenGL::render_begin();
+            bake.fb.release();
+            OpenGL::render_end();
+            memory_ledger_t::get().add(MEMORY_BAKES, -bake.bytes);
+            bake.bytes  = 0;
+            bake.serial = 0;
+        }
 
-        /** Accent variables */
-        struct accent_texture_t {
-            simple_texture_t t_trbr[2];
-            simple_texture_t t_tlbl[2];
-            int radius;
-        };
+        /** When the decoration was last drawn, to evict the ones unseen for the longest first */
+        uint32_t last_drawn = 0;
+
+        uint32_t get_last_drawn() const override {
+            return last_drawn;
+        }
+
+        int64_t get_memory_usage() const override {
+            int64_t bytes = 0;
+            auto count = [&] (const atlas_handle_t& handle) {
+                bytes += handle ? handle->get_bytes() : 0;
+            };
+
+            title.masks.for_each(count);
+            icon.textures.for_each(count);
+            for (const auto& bake : bakes) {
+                bytes += bake.bytes;
+            }
+
+            for (auto area : layout.get_renderable_areas()) {
+                if (area->get_type() == DECORATION_AREA_BUTTON) {
+                    bytes += area->as_button().get_memory_usage();
+                }
+            }
+
+            return bytes;
+        }
+
+        /** Drop the bakes, title, icon and buttons, all of them are built again when drawn */
+        void evict_memory() override {
+            for (auto& bake : bakes) {
+                release_bake(bake);
+            }
+
+            title.mask.reset();
+            title.masks.clear();
+            title.stale = true;
+            icon.texture.reset();
+            icon.textures.clear();
+            for (auto area : layout.get_renderable_areas()) {
+                if (area->get_type() == DECORATION_AREA_BUTTON) {
+                    area->as_button().evict_textures();
+                }
+            }
+        }
 
-        std::vector<accent_texture_t> accent_textures;
+        /** How the frame is sliced for baking, computed along with the plan */
+        struct {
+            int top, bottom, left, right;
+            /** Columns are a few pixels tall and stretched when only the frame crosses them */
+            bool stretch;
+            int column;
+            /** The size of the baked texture */
+            dimensions_t size;
+            bool valid = false;
+        } slices;
+
+        /** Bumped whenever anything drawn by the plan changes */
+        uint64_t content_serial = 1;
+        uint64_t stable_serial  = 0;
+        int stable_frames = 0;
 
         // Other general variables
         decoration_theme_t theme;
         decoration_layout_t layout;
         region_t cached_region;
+        /** The cached region at the offset it is drawn at */
+        region_t offset_region;
         dimensions_t size;
 
-    void update_corners(edge_colors_t colors, int corner_radius, double scale) {
-		if ((this->corner_radius != corner_radius) ||
-			(edges.border != colors.border) ||
-			(edges.outline != colors.outline)) {
-    		corners.tr.r = corners.tl.r = corners.bl.r = corners.br.r = 0;
-
-    		std::stringstream round_on_str(theme.get_round_on());
-    		std::string corner;
-    		while (round_on_str >> corner) {
-        		if (corner == "all") {
-            		corners.tr.r = corners.tl.r = corners.bl.r = corners.br.r
-        		                 = theme.get_corner_radius() * scale;
-            		break;
-        		} else if (corner == "tr") {
-            		corners.tr.r = (theme.get_corner_radius() * scale);
-        		} else if (corner == "tl") {
-            		corners.tl.r = (theme.get_corner_radius() * scale);
-        		} else if (corner == "bl") {
-            		corners.bl.r = (theme.get_corner_radius() * scale);
-        		} else if (corner == "br") {
-            		corners.br.r = (theme.get_corner_radius() * scale);
-        		}
-    		}
-    		int height = std::max( { corner_radius, border_size.top,
-    		                         border_size.bottom });
-    		auto create_s_and_t = [&](corner_texture_t& t, matrix<double> m, int r) {
-        		for (auto a : { ACTIVE, INACTIVE }) {
-            		t.surf[a] = theme.form_corner(a, r, m, height);
-        			cairo_surface_upload_to_texture(t.surf[a], t.tex[a]);
-        		}
-    		};
-    		/** The transformations are how we create 4 different corners */
-    		create_s_and_t(corners.tr, { scale, 0, 0, scale }, corners.tr.r);
-    		create_s_and_t(corners.tl, { -scale, 0, 0, scale }, corners.tl.r);
-    		create_s_and_t(corners.bl, { -scale, 0, 0, -scale }, corners.bl.r);
-    		create_s_and_t(corners.br, { scale, 0, 0, -scale }, corners.br.r);
-
-    		corners.tr.g = { size.width - corner_radius, 0,
-    		                     corner_radius, height };
-    		corners.tl.g = { 0, 0, corner_radius, height };
-    		corners.bl.g = { 0, size.height - height, corner_radius, height };
-    		corners.br.g = { size.width - corner_radius, size.height - height,
-    		                     corner_radius, height };
-
-			edges.border.active    = colors.border.active;
-			edges.border.inactive  = colors.border.inactive;
-			edges.outline.active   = colors.outline.active;
-			edges.outline.inactive = colors.outline.inactive;
-			this->corner_radius    = corner_radius;
-		}
-	}
-
     public:
         border_size_t border_size;
-        int corner_radius;
+        /** Bumped whenever border_size is parsed again, for the decorator's cached margins */
+        uint64_t border_serial = 0;
+        int corner_radius = 0;
 
         template<typename T>
-        T get_option(std::string theme, std::string option_name) {
+        static T get_option(std::string theme, std::string option_name) {
             wf::config::config_manager_t& config = wf::get_core().config;
             auto option = config.get_option<std::string>(theme + "/" + option_name);
             if (option == nullptr || theme == "default") {
@@ -217,7 +457,8 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
             }
         }
 
-        theme_options get_options(std::string theme) {
+        static theme_options get_options(std::string theme) {
+            profile_scope_t profile{PROFILE_OPTIONS};
             theme_options options = {
                 get_option<std::string>(theme, "font"),
                 get_option<int>(theme, "font_size"),
@@ -252,24 +493,93 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
             return options;
         }
 
-        simple_decoration_node_t(wayfire_toplevel_view view)
+        simple_decoration_node_t(wayfire_toplevel_view view, const theme_options& options)
             : node_t(false),
-              theme{get_options("default")},
+              theme{options},
               layout{theme, [=, this] (wlr_box box) {
+                  content_serial++;
                   wf::scene::damage_node(shared_from_this(), box + get_offset()); }} {
+            has_title = this->theme.has_title_orientation(HORIZONTAL);
+            memory_ledger_t::get().add_client(this);
+            attach(view);
+        }
+
+        /** @return Whether the node's theme was built from the options, so that it can decorate with them */
+        bool has_options(const theme_options& options) const {
+            return theme.get_theme_options() == options;
+        }
+
+        /** Start decorating the view, as a new node or one taken from the pool */
+        void attach(wayfire_toplevel_view view) {
             this->_view = view->weak_from_this();
             view->connect(&title_set);
+            view->connect(&app_id_set);
+            view->connect(&on_set_output);
 
             title.dims = {0, 0};
+            title_changed = true;
+            icon.app_id_changed = true;
+            select_plan_updater(view->toplevel()->current().tiled_edges);
 
             // make sure to hide frame if the view is fullscreen
             update_decoration_size();
         }
 
+        /**
+         * Stop decorating the view, before the node goes to the pool. The bakes'
+         * framebuffers, the icons and the atlas stay, only what shows
+         * the old view is drawn again.
+         */
+        void detach() {
+            title_set.disconnect();
+            app_id_set.disconnect();
+            on_set_output.disconnect();
+            unhook_title_change();
+            title_timer.disconnect();
+            unused_state_timer.disconnect();
+            layout.handle_focus_lost();
+            _view.reset();
+
+            title.mask.reset();
+            title.masks.clear();
+            title.text  = "";
+            title.area  = { 0, 0, 0, 0 };
+            title.stale = true;
+            plan.clear();
+            /** Leaves the bakes out of date, while keeping their framebuffers */
+            content_serial++;
+            stable_frames = 0;
+        }
+
+        ~simple_decoration_node_t() {
+            memory_ledger_t::get().remove_client(this);
+            unhook_title_change();
+            for (auto& bake : bakes) {
+                release_bake(bake);
+            }
+        }
+
         point_t get_offset() {
             return { -border_size.left, -border_size.top };
         }
 
+        /** Bring offset_region up to date, after the cached region or the border changed */
+        void update_offset_region() {
+            offset_region = cached_region + get_offset();
+        }
+
+#ifdef COSMODECOR_ALLOC_CHECK
+        /** Everything a frame may change, frames which change none of it are checked */
+        using frame_state_t = std::tuple<uint64_t, uint64_t, uint64_t, double, double, int, uint64_t,
+                                         bool, double>;
+
+        frame_state_t get_frame_state(double scale) {
+            auto view = _view.lock();
+            return { content_serial, bakes[0].serial, bakes[1].serial, bakes[0].scale, bakes[1].scale,
+                     stable_frames, texture_atlas_t::get_upload_count(), view && view->activated, scale };
+        }
+#endif
+
         class decoration_render_instance_t : public wf::scene::render_instance_t
         {
             simple_decoration_node_t *self;
@@ -290,8 +600,14 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
             void schedule_instructions(std::vector<wf::scene::render_instruction_t>& instructions,
                                        const wf::render_target_t& target, wf::region_t& damage) override
             {
-                auto our_region = self->cached_region + self->get_offset();
-                wf::region_t our_damage = damage & our_region;
+                /** Most frames damage other views, those are skipped without building a region */
+                auto overlap = wf::geometry_intersection(damage.get_extents(),
+                                                         self->offset_region.get_extents());
+                if ((overlap.width <= 0) || (overlap.height <= 0)) {
+                    return;
+                }
+
+                wf::region_t our_damage = damage & self->offset_region;
                 if (!our_damage.empty()) {
                     instructions.push_back(wf::scene::render_instruction_t{
                             .instance = this,
@@ -304,20 +620,29 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
             void render(const wf::render_target_t& target,
                         const wf::region_t& region) override
             {
+#ifdef COSMODECOR_ALLOC_CHECK
+                size_t allocations = alloc_check_t::count();
+                auto state = self->get_frame_state(target.scale);
+#endif
+                startup_profile_t::get().begin_render();
+                self->last_scale = target.scale;
                 self->update_layout(DONT_FORCE, target.scale);
 
-                int x = self->get_offset().x;
-                int y = self->get_offset().y;
-                int h = std::max({ self->corner_radius, self->border_size.top, self->border_size.bottom });
-                self->corners.tr.g = { self->size.width - self->corner_radius, 0, self->corner_radius, h };
-                self->corners.bl.g = { 0, self->size.height - h, self->corner_radius, h };
-                self->corners.br.g = { self->size.width - self->corner_radius,
-                                    self->size.height - h, self->corner_radius, h };
-
-                for (const auto& box : region) {
-                    self->render_scissor_box(target, {x, y}, wlr_box_from_pixman_box(box));
+                self->render_plan(target, self->get_offset(), region);
+                startup_profile_t::get().end_render();
+#ifdef COSMODECOR_ALLOC_CHECK
+                /** A frame like the previous one, which changed nothing, must not allocate */
+                if ((state == last_state) && (state == self->get_frame_state(target.scale))) {
+                    alloc_check_t::expect_none(allocations, "decoration frame");
                 }
+
+                last_state = state;
+#endif
             }
+
+#ifdef COSMODECOR_ALLOC_CHECK
+            frame_state_t last_state;
+#endif
         };
 
         void gen_render_instances(std::vector<wf::scene::render_instance_uptr>& instances,
@@ -331,429 +656,280 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
             return wf::construct_box(get_offset(), size);
         }
 
-        void render_title(const render_target_t& fb, geometry_t geometry, geometry_t scissor) {
-            if (title_needs_update) {
-                update_title(fb.scale);
-            }
-
-            if (auto view = _view.lock()) {
-                simple_texture_t *texture;
-                uint32_t bits = OpenGL::TEXTURE_TRANSFORM_INVERT_Y;
-                texture = &title.hor[view->activated];
-
-                // optimization skipping damage that is outside of title bar area (below it)
-                if (scissor.y < 0) {
-                    OpenGL::render_begin(fb);
-                    fb.logic_scissor(scissor);
-                    OpenGL::render_texture(texture->tex, fb, geometry, glm::vec4(1.0f), bits);
-                    OpenGL::render_end();
-                }
-            }
-        }
-
-        void render_icon(const render_target_t& fb, geometry_t g,
-                         const geometry_t& scissor, int32_t bits) {
-            update_icon(fb.scale);
-            OpenGL::render_begin(fb);
-            fb.logic_scissor(scissor);
-            OpenGL::render_texture(icon.texture.tex, fb, g, glm::vec4(1.0f), bits);
-            OpenGL::render_end();
-        }
-
         color_t alpha_trans(color_t c) {
             return { c.r * c.a, c.g * c.a, c.b * c.a, c.a };
         }
 
-    void form_accent_corners(int r, geometry_t accent, std::string corner_style,
-                             matrix<int> m, edge_t edge) {
-        if (auto view = _view.lock()) {
-        const auto format = CAIRO_FORMAT_ARGB32;
-        cairo_surface_t *surfaces[4];
-        double angle = 0;
-
-        /** Colors of the accent and background, respectively */
-        color_t a_color;
-        color_t b_color;
-
-        wf::point_t a_origin = { accent.x, accent.y };
-
-        int h = std::max({ corner_radius, border_size.top, border_size.bottom });
-
-        wf::geometry_t a_edges[2];
-        if (m.xx == 1) {
-            a_edges[0] = { 0, 0, r, accent.height };
-            a_edges[1] = { accent.width - r, 0, r, accent.height };
-        } else {
-            a_edges[0] = { 0, 0, accent.width, r };
-            a_edges[1] = { 0, accent.height - r, accent.width, r };
+        /** Place the corners on the current size, they don't depend on the scale */
+        void place_corners() {
+            uint32_t round_on = theme.get_round_on_mask();
+            int h = std::max({ corner_radius, border_size.top, border_size.bottom });
+            corners.tr = { { size.width - corner_radius, 0, corner_radius, h },
+                           (round_on & CORNER_TR) ? corner_radius : 0 };
+            corners.tl = { { 0, 0, corner_radius, h },
+                           (round_on & CORNER_TL) ? corner_radius : 0 };
+            corners.bl = { { 0, size.height - h, corner_radius, h },
+                           (round_on & CORNER_BL) ? corner_radius : 0 };
+            corners.br = { { size.width - corner_radius, size.height - h, corner_radius, h },
+                           (round_on & CORNER_BR) ? corner_radius : 0 };
         }
 
-        wf::geometry_t cut;
-        if (m.xy == 0) { 
-            cut = { accent.x + r, accent.y, accent.width - 2 * r, accent.height };
-        } else {
-            cut = { accent.x, accent.y + r, accent.width, accent.height - 2 * r };
-        }
+        /**
+         * Build the render plan: the frame, split into disjoint pieces, then the
+         * title, icon and buttons, all relative to the origin.
+         */
+        template<uint32_t F>
+        void build_plan() {
+            phase_scope_t phase{PHASE_BUILD_PLAN};
+            plan.clear();
+            plan_has_icon = false;
+            place_corners();
+
+            /** The corners and every background area, shaded by the frame shader */
+            region_t frame_region;
+            if constexpr ((F & FEATURE_ROUNDED) != 0) {
+                for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br }) {
+                    frame_region |= c->g;
+                }
+            }
 
-        /**** Creation of the master path, containing all accent edge textures */
-        const cairo_matrix_t matrix = {
-            (double)m.xx, (double)m.xy, (double)m.yx, (double)m.yy, 0, 0
-        };
+            // Borders
+            for (auto area : layout.get_background_areas()) {
+                frame_region |= area->get_geometry();
+            }
 
-        /** Array used to determine if a line starts on the corner or not */
-        struct { int tr = 0, br = 0, bl = 0, tl = 0; } retract;
+            for (const auto& box : frame_region) {
+                plan.add_frame(wlr_box_from_pixman_box(box));
+            }
 
-        /** Calculate where to retract, based on diagonality */
-        for (int i = 0; auto c : corner_style) {
-            if (c == '/') {
-                if (i == 0) { 
-                    retract.tl = r ;
-                } else {
-                    retract.br = r;
-                }
-                i++;
-            } else if (c == '\\') {
-                if (i == 0) { 
-                    retract.bl = r ;
-                } else {
-                    retract.tr = r;
+            int o_s = 0;
+            if constexpr ((F & FEATURE_OUTLINE) != 0) {
+                o_s = theme.get_outline_size();
+            }
+
+            frame_params_t frame = {
+                { 0, 0, size.width, size.height },
+                corners.tr.r, corners.tl.r, corners.bl.r, corners.br.r, o_s, {}, {}
+            };
+            frame_params_t active = frame, inactive = frame;
+            inactive.border_color = alpha_trans(theme.get_border_colors().inactive);
+            inactive.outline_color = alpha_trans(theme.get_outline_colors().inactive);
+            active.border_color = alpha_trans(theme.get_border_colors().active);
+            active.outline_color = alpha_trans(theme.get_outline_colors().active);
+            plan.set_frame(inactive, active);
+
+            wf::geometry_t geometry = { 0, 0, size.width, size.height };
+            for (auto item : layout.get_renderable_areas()) {
+                if (item->get_type() == DECORATION_AREA_TITLE) {
+                    /** The layout already fits the title between the other areas */
+                    color_set_t colors = {
+                        alpha_trans(title.colors.active), alpha_trans(title.colors.inactive)
+                    };
+                    plan.add_mask(&title.mask, colors, item->get_geometry(),
+                                  OpenGL::TEXTURE_TRANSFORM_INVERT_Y, item->get_geometry());
+                } else if (item->get_type() == DECORATION_AREA_BUTTON) {
+                    plan.add_button(&item->as_button(), item->get_geometry(), geometry);
+                } else if (item->get_type() == DECORATION_AREA_ICON) {
+                    plan.add_texture(&icon.texture, &icon.texture, item->get_geometry(), 0, geometry);
+                    plan_has_icon = true;
                 }
-                i++;
-            } else if (c == '!') {
-                i++;
             }
+
+            place_slices();
+            plan.set_built();
+            content_serial++;
         }
 
-        /** "Untransformed" accent area, used for correct transformations later on */
-        const wf::dimensions_t mod_a = {
-            abs(accent.width * m.xx + accent.height * m.xy),
-            abs(accent.width * m.yx + accent.height * m.yy)
-        };
+        /** Slice the frame into rows and columns, see bake_t */
+        void place_slices() {
+            int corner_height = (corner_radius > 0) ? corners.tl.g.height : 0;
+            slices.top    = std::max(border_size.top, corner_height);
+            slices.bottom = std::max(border_size.bottom, corner_height);
+            slices.left   = std::max(border_size.left, corner_radius);
+            slices.right  = std::max(border_size.right, corner_radius);
+
+            int middle = size.height - slices.top - slices.bottom;
+            slices.valid   = (middle > 0) && (slices.left + slices.right < size.width);
+            slices.stretch = plan.only_frame_within({ 0, slices.top, size.width, middle });
+            slices.column  = slices.stretch ? 3 : middle;
+            slices.size    = {
+                std::max(size.width, slices.left + slices.right),
+                slices.top + slices.bottom + slices.column
+            };
+        }
 
-        auto full_surface = cairo_image_surface_create(format, accent.width,
-                                                       accent.height);
-        auto cr = cairo_create(full_surface);
+        /** Render the frame into the bake of the given activation state */
+        void bake_frame(bake_t& bake, bool active, double scale) {
+            phase_scope_t phase{PHASE_BAKE};
+            phase_profile_t::count(COUNTER_BAKES);
+            OpenGL::render_begin();
+            bake.fb.allocate(std::ceil(slices.size.width * scale),
+                             std::ceil(slices.size.height * scale));
+            OpenGL::render_end();
 
-        /** A corner indexing array and the string with the final corners to round */
-        std::string c_strs[4] = { "br", "tr", "tl", "bl" };
-        std::string to_round;
+            int64_t bytes = (int64_t)bake.fb.viewport_width * bake.fb.viewport_height * 4;
+            memory_ledger_t::get().add(MEMORY_BAKES, bytes - bake.bytes);
+            bake.bytes = bytes;
 
-        /** Deciding which corners to round, based on the string and on rotation */
-        if (corner_style == "a") {
-            to_round = "brtrtlbl";
-            retract.br = r;
-        } else {
-            /** True mathematical modulo */
-            auto modulo = [](int a, int b) -> int {
-               return a - b * floor((double)a / b);
-            };
+            wf::render_target_t target{bake.fb};
+            target.geometry = { 0, 0, slices.size.width, slices.size.height };
+            target.scale = scale;
+            OpenGL::render_begin(target);
+            OpenGL::clear({ 0, 0, 0, 0 });
+            OpenGL::render_end();
 
-            for (int c_to_rotate = 0; auto str : c_strs) {
-               if (corner_style.find(str) != std::string::npos) {
+            /** Where each slice goes in the bake, and where it is on the decoration */
+            int columns = slices.top + slices.bottom;
+            const struct {
+                geometry_t to;
+                point_t from;
+            } parts[] = {
+                { { 0, 0, size.width, slices.top }, { 0, 0 } },
+                { { 0, slices.top, size.width, slices.bottom }, { 0, size.height - slices.bottom } },
+                { { 0, columns, slices.left, slices.column }, { 0, slices.top } },
+                { { slices.left, columns, slices.right, slices.column },
+                  { size.width - slices.right, slices.top } },
+            };
 
-                   /**
-                    * This function effectively rotates the chosen corner.
-                    * When m.xy == 1 (left edge), br becomes tr, tr becomes tl, etc.
-                    * On the right edge, the opposite happens.
-                    * This is to keep the correct corners rounded for the end user.
-                    */
-                   to_round += c_strs[modulo(c_to_rotate - m.xy, 4)];
-                   if (modulo(c_to_rotate - m.xy, 4) == 0) { retract.br = r; }
-               }
-               c_to_rotate++;
+            for (const auto& part : parts) {
+                region_t damage{part.to};
+                draw_list.clear();
+                plan.execute(draw_list, { part.to.x - part.from.x, part.to.y - part.from.y },
+                             damage, active, scale, *atlas);
+                draw_list.submit(target, damage);
             }
+
+            bake.serial = content_serial;
+            bake.scale  = scale;
         }
 
-        /** Point of rotation, in case it is needed */
-        int rotation_x_d = ((m.xy == 1) ? mod_a.height : mod_a.width ) / 2;
-        wf::point_t rotation_point = { rotation_x_d, rotation_x_d };
+        /** Draw the bake as four quads, the rows and the stretched or copied columns */
+        void render_bake(const bake_t& bake, const render_target_t& fb, point_t origin,
+                         const region_t& damage) {
+            int middle   = size.height - slices.top - slices.bottom;
+            int column_y = slices.top + slices.bottom + (slices.stretch ? 1 : 0);
+            int column_h = slices.stretch ? 1 : slices.column;
+            const struct {
+                geometry_t to, from;
+            } quads[] = {
+                { { 0, 0, size.width, slices.top }, { 0, 0, size.width, slices.top } },
+                { { 0, size.height - slices.bottom, size.width, slices.bottom },
+                  { 0, slices.top, size.width, slices.bottom } },
+                { { 0, slices.top, slices.left, middle }, { 0, column_y, slices.left, column_h } },
+                { { size.width - slices.right, slices.top, slices.right, middle },
+                  { slices.left, column_y, slices.right, column_h } },
+            };
 
-        /** Rotation depending on the edge */
-        cairo_translate(cr, rotation_point);
-        cairo_transform(cr, &matrix);
-        cairo_translate(cr, -rotation_point);
+            /** The framebuffer is rounded up to whole pixels, the bake only fills slices.size * scale of it */
+            wf::pointf_t bake_size = {
+                bake.fb.viewport_width / bake.scale, bake.fb.viewport_height / bake.scale
+            };
 
-        /** Lambda that creates a rounded or flat corner */
-        auto create_corner = [&](int w, int h, int i) {
-            if (to_round.find(c_strs[i]) != std::string::npos) {
-                cairo_arc(cr, w + ((i < 2) ? -r : r), h + ((i % 3 == 0) ? r : -r), r,
-                          M_PI_2 * (i - 1), M_PI_2 * i);
-            } else {
-                if (i % 2 == 0) { cairo_line_to(cr, w, h); }
-                cairo_line_to(cr, w, h + ((i == 0) ? r : ((i == 2) ? -r : 0)));
+            draw_list.clear();
+            for (const auto& quad : quads) {
+                geometry_t to = quad.to + origin;
+                for (const auto& box : damage) {
+                    draw_list.add_texture(bake.fb.tex, quad.from, bake_size, to, 0,
+                                          wlr_box_from_pixman_box(box));
+                }
             }
-        };
 
-        cairo_move_to(cr, mod_a.width - retract.br, 0);
-        if (to_round.find("r") == std::string::npos) {
-            cairo_line_to(cr, mod_a.width - retract.tr, mod_a.height);
-        } else {
-            create_corner(mod_a.width, 0, 0);
-            create_corner(mod_a.width, mod_a.height, 1);
+            draw_list.submit(fb, damage);
         }
-        if (to_round.find("l") == std::string::npos) {
-            cairo_line_to(cr, retract.tl, mod_a.height);
-            cairo_line_to(cr, retract.bl, 0);
-        } else {
-            create_corner(0, mod_a.height, 2);
-            create_corner(0, 0, 3);
-        }
-        cairo_close_path(cr);
-        auto master_path = cairo_copy_path(cr);
-        cairo_destroy(cr);
-        cairo_surface_destroy(full_surface);
-        /****/
-        
-        for (int i = 0, j = 0; i < 4; i++, angle += M_PI / 2, j = i % 2) {
-            if (i < 2) {
-                a_color = theme.get_accent_colors().inactive;
-                b_color = theme.get_border_colors().inactive;
-            } else {
-                a_color = theme.get_accent_colors().active;
-                b_color = theme.get_border_colors().active;
-            }
-            int width = a_edges[j].width;
-            int height = a_edges[j].height;
-                
-            surfaces[i] = cairo_image_surface_create(format, width, height);
-            auto cr_a = cairo_create(surfaces[i]);
-
-            /** Background rectangle, behind the accent's corner */
-            cairo_set_source_rgba(cr_a, b_color);
-            cairo_rectangle(cr_a, 0, 0, a_edges[j].width, a_edges[j].height);
-            cairo_fill(cr_a);
-
-            /**** Outline, done early so it can also be cropped off */
-            /** Translation to the correct rotation */
-            cairo_translate(cr_a , rotation_point); 
-            cairo_transform(cr_a , &matrix);
-            cairo_translate(cr_a , -rotation_point); 
-
-            int o_size = theme.get_outline_size();
-            auto outline_color = (view->activated) ?
-                                 alpha_trans(theme.get_outline_colors().active) :
-                                 alpha_trans(theme.get_outline_colors().inactive);
-
-
-            /** Draw outline on the bottom in case it is in the bottom edge */
-            int h_offset = (edge == EDGE_BOTTOM) ? mod_a.height : o_size;
-
-            cairo_set_source_rgba(cr_a, outline_color);
-            cairo_rectangle(cr_a, 0, mod_a.height - h_offset, mod_a.width, o_size);
-            cairo_fill(cr_a);
-            /****/
-
-            /** Dealing with intersection between the view's corners and accent */
-            for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br } ) {
-
-                /** Accent edge translated by the accent's origin */
-                wf::geometry_t a_edge = a_edges[j] + a_origin;
-
-                /** Skip everything if the areas don't intersect */
-                auto in = geometry_intersection(a_edge, c->g);
-                if (in.width == 0 || in.height == 0) { continue; }
-
-                /**** Rectangle to cut the background from the accent's corner */
-                /** View's corner position relative to the accent's corner */
-                point_t v_rel_a = { 
-                    c->g.x - a_edge.x, c->g.y - a_edge.y
-                };
 
-                cairo_set_operator(cr_a, CAIRO_OPERATOR_CLEAR);
-                cairo_rectangle(cr_a, v_rel_a, corner_radius, h);
-                cairo_fill(cr_a);
-                /****/
-
-                /** Removal of intersecting areas from the view corner */
-                for (auto active : { ACTIVE, INACTIVE }) {
-
-                    /**** Removing the edges with cut, flat, or diagonal corners */
-                    /** Surface to remove from, the view corner in this case */
-                    auto cr_v = cairo_create(c->surf[active]);
-                    cairo_set_operator(cr_v, CAIRO_OPERATOR_CLEAR);
-
-                    /** Transformed br accent corner, relative to the view corner */
-                    wf::point_t t_br_rel_v = {
-                        (a_origin.x) - c->g.x,
-                        (c->g.y + c->g.height) - (a_origin.y + accent.height)
-                    };
+        /** Bring the corner radius up to date, and rebuild the plan if anything moved */
+        template<uint32_t F>
+        void update_plan(const render_target_t&) {
+            int r = 0;
+            if constexpr ((F & FEATURE_ROUNDED) != 0) {
+                r = theme.get_corner_radius();
+            }
 
-                    cairo_translate(cr_v, t_br_rel_v.x, t_br_rel_v.y);
-
-                    cairo_translate(cr_v , rotation_point); 
-                    cairo_transform(cr_v , &matrix);
-                    cairo_translate(cr_v , -rotation_point); 
-
-                    cairo_append_path(cr_v, master_path);
-                    cairo_fill(cr);
-                    /****/
-
-                    /**** Clear the view's corner with the accent rectangles */
-                    /** Bottom of the rectangle relative to the view's corner */
-                    wf::point_t reb_rel_v;
-                    reb_rel_v.y = (c->g.y + c->g.height) - (cut.y + cut.height);
-                    reb_rel_v.x = (cut.x - c->g.x);
-
-                    cairo_set_operator(cr_v, CAIRO_OPERATOR_CLEAR);
-                    cairo_rectangle(cr_v, reb_rel_v, cut.width, cut.height);
-                    cairo_fill(cr_v);
-                    /****/
-                            
-                    cairo_surface_upload_to_texture(c->surf[active], c->tex[active]);
-                    cairo_destroy(cr_v);
-                }
+            if (corner_radius != r) {
+                corner_radius = r;
+                plan.clear();
             }
 
-            /**** Final drawing of accent corner, overlaying the drawn rectangle */
-            cairo_set_operator(cr_a, CAIRO_OPERATOR_SOURCE);
+            if (plan.is_dirty()) {
+                build_plan<F>();
+            }
+        }
 
-            wf::point_t t_br = {
-                (r - mod_a.width) * (m.xx * (i % 2) + m.xy * (1 - i % 2)), 0
+        using plan_updater_t = void (simple_decoration_node_t::*)(const render_target_t&);
+        /** The update_plan variant for the theme's features and the tiled state */
+        plan_updater_t plan_updater = nullptr;
+
+        /**
+         * Pick the update_plan specialization once, instead of checking the
+         * theme's features on every frame. Tiled views lose their corners.
+         */
+        void select_plan_updater(bool tiled) {
+            static constexpr plan_updater_t updaters[] = {
+                &simple_decoration_node_t::update_plan<0>,
+                &simple_decoration_node_t::update_plan<1>,
+                &simple_decoration_node_t::update_plan<2>,
+                &simple_decoration_node_t::update_plan<3>,
             };
 
-            cairo_set_source_rgba(cr_a, a_color);
-            cairo_translate(cr_a, t_br.x, t_br.y);
-            cairo_append_path(cr_a, master_path);
-            cairo_fill(cr_a);
-            cairo_destroy(cr_a);
-            /****/
-        }
-        auto& texture = accent_textures.back();
-        cairo_surface_upload_to_texture(surfaces[0], texture.t_trbr[INACTIVE]);
-        cairo_surface_upload_to_texture(surfaces[1], texture.t_tlbl[INACTIVE]);
-        cairo_surface_upload_to_texture(surfaces[2], texture.t_trbr[ACTIVE]);
-        cairo_surface_upload_to_texture(surfaces[3], texture.t_tlbl[ACTIVE]);
-        texture.radius = r;
+            uint32_t features = theme.get_features();
+            if (tiled) {
+                features &= ~FEATURE_ROUNDED;
+            }
 
-        for (auto surface : surfaces) { cairo_surface_destroy(surface); }
-        cairo_path_destroy(master_path);
+            if (plan_updater != updaters[features]) {
+                plan_updater = updaters[features];
+                plan.clear();
+            }
         }
-    }
 
-        void render_background_area(const render_target_t& fb, geometry_t g,
-                                point_t rect, geometry_t scissor,
-                                std::string rounded, unsigned long i,
-                                decoration_area_type_t type, matrix<int> m,
-                                edge_t edge) {
+        /** Draw the decoration's plan on the damaged part of the target */
+        void render_plan(const render_target_t& fb, point_t origin, const region_t& damage) {
             if (auto view = _view.lock()) {
-                // The view's origin
-                point_t o = { rect.x, rect.y };
-
-                /**** Render the corners of an accent */
-                int r;
+                /** Textures uploaded on the previous output stay valid, all outputs share the context */
+                if (!atlas || (view->get_output() != atlas_output)) {
+                    atlas_output = view->get_output();
+                    atlas = texture_atlas_t::get(atlas_output);
+                }
 
-                corner_radius = (view->toplevel()->current().tiled_edges)? 0 : corner_radius;
+                (this->*plan_updater)(fb);
 
-                /** Create the corners, it should happen once per accent */
-                if (accent_textures.size() <= i) {
-                    accent_textures.resize(i + 1);
-                    r = std::min({ ceil((double)g.height / 2), ceil((double)g.width / 2),
-                                (double)corner_radius});
-                    form_accent_corners(r, g, rounded, m, edge);
+                if (has_title) {
+                    update_title(fb.scale);
                 }
 
-                r = accent_textures.at(i).radius;
-
-                // Render a single rectangle when the area is a background
-                color_t color = (view->activated) ?
-                    alpha_trans(theme.get_border_colors().active) :
-                    alpha_trans(theme.get_border_colors().inactive);
-                color_t o_color = (view->activated) ?
-                    alpha_trans(theme.get_outline_colors().active) :
-                    alpha_trans(theme.get_outline_colors().inactive);
-
-                wf::geometry_t g_o;
-                int o_s = theme.get_outline_size();
-                if (edge == wf::cosmodecor::EDGE_TOP) {
-                    g_o = { g.x, g.y, g.width, o_s };
-                    g = { g.x, g.y + o_s, g.width, g.height - o_s };
-                } else if (edge == wf::cosmodecor::EDGE_BOTTOM) {
-                    g_o = { g.x, g.y + g.height - o_s, g.width, o_s };
-                    g = { g.x, g.y, g.width, g.height - o_s };
-                } else if (edge == wf::cosmodecor::EDGE_LEFT) {
-                    // the g.y + is probably not correct, but works for now
-                    g_o = { g.x, g.y - ((corner_radius > 0) ? 0: +border_size.top), o_s, g.y + g.height + ((corner_radius > 0) ? -corner_radius: +border_size.top) };
-                    g = { g.x + o_s, g.y, g.width - o_s, g.y + g.height - corner_radius };
-                } else if (edge == wf::cosmodecor::EDGE_RIGHT) {
-                    // the g.y + is probably not correct, but works for now
-                    g_o = { g.x + g.width - o_s, g.y - ((corner_radius > 0) ? 0: +border_size.top), o_s, g.y + g.height  + ((corner_radius > 0) ? -corner_radius: +border_size.top) };
-                    g = { g.x, g.y, g.width - o_s, g.y + g.height - corner_radius };
+                if (plan_has_icon) {
+                    update_icon(fb.scale);
                 }
-                g_o = g_o + o;
 
-                OpenGL::render_begin(fb);
-                fb.logic_scissor(scissor);
-                /** Outlines */
-                bool a = view->activated;
-                /** Rendering all corners */
-                for (auto *c : { &corners.tr, &corners.tl, &corners.bl, &corners.br }) {
-                    OpenGL::render_texture(c->tex[a].tex, fb, c->g + o, glm::vec4(1.0f));
+                if (stable_serial != content_serial) {
+                    stable_serial = content_serial;
+                    stable_frames = 0;
+                } else if (stable_frames < BAKE_AFTER_FRAMES) {
+                    stable_frames++;
                 }
-                
-                OpenGL::render_rectangle(g + o, color, fb.get_orthographic_projection());
-                OpenGL::render_rectangle(g_o, o_color, fb.get_orthographic_projection());
-                OpenGL::render_end();
-            }
-        }
-
-        void render_background(const render_target_t& fb, geometry_t rect,
-                               const geometry_t& scissor) {
-            if (auto view = _view.lock()) {
-                edge_colors_t colors = {
-                theme.get_border_colors(), theme.get_outline_colors()
-            };
-
-            colors.border.active = alpha_trans(colors.border.active);
-            colors.border.inactive = alpha_trans(colors.border.inactive);
-
-            int r = (view->toplevel()->current().tiled_edges)? 0 : theme.get_corner_radius() * fb.scale;
-            update_corners(colors, r, fb.scale);
-
-            // Borders
-            unsigned long i = 0;
-            point_t rect_o = { rect.x, rect.y };
-
-            for (auto area : layout.get_background_areas()) {
-                render_background_area(fb, area->get_geometry(), rect_o, scissor, area->get_corners(), i, area->get_type(),
-                                       area->get_m(), area->get_edge());
-                i++;
-            }
-            }
-        }
 
-        void render_scissor_box(const render_target_t& fb, point_t origin,
-                                const wlr_box& scissor) {
-            /** Draw the background (corners and border) */
-            wlr_box geometry{origin.x, origin.y, size.width, size.height};
-            render_background(fb, geometry, scissor);
-
-            wlr_box clip = scissor;
-            if (!wlr_box_intersection(&clip, &scissor, &geometry)) {
-                return;
-            }
+                /** Idle decorations are drawn from their bake, rebaked once they settle again */
+                auto& bake = bakes[view->activated];
+                uint32_t now = wf::get_current_time();
+                last_drawn = now;
+                bool baked = (bake.serial == content_serial) && (bake.scale == fb.scale);
+                bool in_use_elsewhere = (bake.serial == content_serial) &&
+                                        (now - bake.drawn_at < BAKE_SCALE_GRACE);
+                if (!baked && !in_use_elsewhere && bake_idle && slices.valid &&
+                    (stable_frames >= BAKE_AFTER_FRAMES)) {
+                    bake_frame(bake, view->activated, fb.scale);
+                    baked = true;
+                }
 
-            auto renderables = layout.get_renderable_areas();
-            for (auto item : renderables) {
-                int32_t bits = 0;
-                if (item->get_type() == DECORATION_AREA_TITLE) {
-                    // clip title so it doesn't overlap with buttons
-                    // FIXME: these sizes should not be hardcoded
-                    wlr_box title_clip = geometry;
-                    title_clip.x += 8;
-                    title_clip.width -= 98;
-
-                    if (wlr_box_intersection(&title_clip, &clip, &title_clip)) {
-                        render_title(fb, item->get_geometry() + origin, title_clip);
-                    }
-                } else if (item->get_type() == DECORATION_AREA_BUTTON) {
-                    if (auto view = _view.lock()) {
-                        item->as_button().set_active(view->activated);
-                        //item->as_button().set_maximized(view->tiled_edges);
-                    }
-                    item->as_button().render(fb, item->get_geometry() + origin, clip);
-                } else if (item->get_type() == DECORATION_AREA_ICON) {
-                    render_icon(fb, item->get_geometry() + origin, clip, bits);
+                if (baked) {
+                    bake.drawn_at = now;
+                    render_bake(bake, fb, origin, damage);
+                    return;
                 }
+
+                draw_list.clear();
+                plan.execute(draw_list, origin, damage, view->activated, fb.scale, *atlas);
+                draw_list.submit(fb, damage);
             }
         }
 
@@ -847,32 +1023,145 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
 
         void resize(dimensions_t dims) {
             if (auto view = _view.lock()) {
-                view->damage();
+                /** Only the frame moves, the client damages its own surface */
+                region_t damage = offset_region;
                 size = dims;
 
+                select_plan_updater(view->toplevel()->current().tiled_edges);
+                profile_scope_t profile{PROFILE_LAYOUT};
                 layout.resize(size.width, size.height, title.dims, view->toplevel()->current().tiled_edges);
+                update_title_area();
+                plan.clear();
 
                 if (!view->toplevel()->current().fullscreen) {
                     this->cached_region = layout.calculate_region();
                 }
-                view->damage();
+
+                update_offset_region();
+                damage |= offset_region;
+                wf::scene::damage_node(shared_from_this(), damage);
             }
         }
 
+        /** Damage the whole frame, but not the client area inside of it */
+        void damage_frame() {
+            damage_local(cached_region);
+        }
+
+        /** Redraw the frame in the new state, and forget the old one if it stays unused */
+        void handle_activation() {
+            /** The focused view shows its title right away, without waiting for the inactive interval */
+            auto view = _view.lock();
+            if (view && view->activated && title_timer.is_connected()) {
+                title_timer.disconnect();
+                hook_title_change();
+            }
+
+            damage_frame();
+            unused_state_timer.set_timeout(UNUSED_STATE_TIMEOUT, [=, this] () {
+                drop_unused_state();
+            });
+        }
+
         void update_decoration_size() {
             bool fullscreen = _view.lock()->toplevel()->current().fullscreen;
             if (fullscreen) {
                 this->cached_region.clear();
             } else {
                 border_size = layout.parse_border(theme.get_border_size());
+                border_serial++;
                 this->cached_region = layout.calculate_region();
             }
+
+            update_offset_region();
         }
     };
 
-    wf::cosmodecor::simple_decorator_t::simple_decorator_t(wayfire_toplevel_view view) {
+    /**
+     * Nodes of views which went away, kept for the next views mapped with the same
+     * theme. Dialogs and other transient windows come and go all the time, and
+     * reusing a node saves building its theme, layout and buttons, and allocating
+     * its bakes again.
+     */
+    class node_pool_t {
+    public:
+        /** The most nodes kept, along with their GL memory, until the next maps */
+        static constexpr size_t MAX_NODES = 8;
+
+        static node_pool_t& get() {
+            static node_pool_t pool;
+            return pool;
+        }
+
+        /** @return A node decorating the view, from the pool if one has the current theme */
+        std::shared_ptr<simple_decoration_node_t> acquire(wayfire_toplevel_view view) {
+            auto options = simple_decoration_node_t::get_options("default");
+            while (!nodes.empty()) {
+                auto node = std::move(nodes.back());
+                nodes.pop_back();
+                /** Nodes of an older theme never match again */
+                if (node->has_options(options)) {
+                    node->attach(view);
+                    return node;
+                }
+            }
+
+            return std::make_shared<simple_decoration_node_t>(view, options);
+        }
+
+        /** Keep a node which was removed from the scene, if nothing else holds it and there is room */
+        void release(std::shared_ptr<simple_decoration_node_t> node) {
+            if ((node.use_count() == 1) && (nodes.size() < MAX_NODES)) {
+                node->detach();
+                nodes.push_back(std::move(node));
+            }
+        }
+
+        void clear() {
+            nodes.clear();
+        }
+
+    private:
+        std::vector<std::shared_ptr<simple_decoration_node_t>> nodes;
+    };
+
+    void wf::cosmodecor::simple_decorator_t::release_node_pool() {
+        node_pool_t::get().clear();
+    }
+
+    wf::cosmodecor::theme_options wf::cosmodecor::simple_decorator_t::get_default_options() {
+        return simple_decoration_node_t::get_options("default");
+    }
+
+    wf::cosmodecor::simple_decorator_t::simple_decorator_t(wayfire_toplevel_view view, bool defer_node) {
         this->view = view;
-        deco       = std::make_shared<simple_decoration_node_t>(view);
+        toplevel   = view->toplevel().get();
+        registry.add(toplevel, this);
+        if (defer_node) {
+            auto border = decoration_layout_t::parse_border(default_border_size);
+            deferred_border = {
+                .left   = border.left,
+                .right  = border.right,
+                .bottom = border.bottom,
+                .top    = border.top,
+            };
+
+            view->connect(&on_deferred_geometry_changed);
+            on_deferred_geometry_changed = [this] (auto) {
+                build_node();
+            };
+        } else {
+            build_node();
+        }
+    }
+
+    void wf::cosmodecor::simple_decorator_t::build_node() {
+        if (deco) {
+            return;
+        }
+
+        on_deferred_geometry_changed.disconnect();
+        deco = node_pool_t::get().acquire(view);
         deco->resize(wf::dimensions(view->get_pending_geometry()));
         wf::scene::add_back(view->get_surface_root_node(), deco);
 
@@ -881,7 +1170,7 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
         view->connect(&on_view_fullscreen);
 
         on_view_activated = [this] (auto) {
-            wf::scene::damage_node(deco, deco->get_bounding_box());
+            deco->handle_activation();
         };
 
         on_view_geometry_changed = [this] (auto) {
@@ -897,21 +1186,26 @@ wf::option_wrapper_t<bool> maximized_titlebar{"cosmodecor/maximized_titlebar"};
     }
 
     wf::cosmodecor::simple_decorator_t::~simple_decorator_t() {
-        wf::scene::remove_child( deco );
+        registry.remove(toplevel, this);
+        if (deco) {
+            wf::scene::remove_child( deco );
+            node_pool_t::get().release(std::move(deco));
+        }
     }
 
     wf::decoration_margins_t wf::cosmodecor::simple_decorator_t::get_margins(const wf::toplevel_state_t& state) {
-        if (state.fullscreen || (!maximized_titlebar && state.tiled_edges)) {
-            return {0, 0, 0, 0};
+        /** Nodes bump their serial on their first parse, so 0 stands for the deferred border */
+        if (!deco) {
+            return cached_margins.get(state, maximized_titlebar, deferred_border, 0);
         }
 
-        auto margins = wf::decoration_margins_t {
+        wf::decoration_margins_t border = {
             .left   = deco->border_size.left,
             .right  = deco->border_size.right,
             .bottom = deco->border_size.bottom,
             .top    = deco->border_size.top,
         };
-        return margins;
+        return cached_margins.get(state, maximized_titlebar, border, deco->border_serial);
     }
 
     // namespace
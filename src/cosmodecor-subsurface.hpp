@@ -6,6 +6,8 @@
 #include <wayfire/toplevel-view.hpp>
 
 #include "cosmodecor-theme.hpp"
+#include "cosmodecor-registry.hpp"
+#include "cosmodecor-margins.hpp"
 
 class simple_decoration_node_t;
 namespace wf::cosmodecor {
@@ -17,15 +19,60 @@ namespace wf::cosmodecor {
      */
     class simple_decorator_t : public wf::custom_data_t {
         wayfire_toplevel_view view;
+        /** The toplevel the decorator is attached to, which outlives it */
+        wf::toplevel_t *toplevel;
+        /** Null until build_node(), for decorators created deferred */
         std::shared_ptr<simple_decoration_node_t> deco;
+        /** The border of the default theme, for margins while the node is deferred */
+        wf::decoration_margins_t deferred_border;
+
+        margins_cache_t cached_margins;
+
+        static inline pointer_registry_t<wf::txn::transaction_object_t, simple_decorator_t> registry;
 
         wf::signal::connection_t<wf::view_activated_state_signal> on_view_activated;
         wf::signal::connection_t<wf::view_geometry_changed_signal> on_view_geometry_changed;
         wf::signal::connection_t<wf::view_fullscreen_signal> on_view_fullscreen;
+        /** Builds a deferred node once the view's margins are applied, whichever transaction applied them */
+        wf::signal::connection_t<wf::view_geometry_changed_signal> on_deferred_geometry_changed;
 
         public:
-            simple_decorator_t(wayfire_toplevel_view view);
+            /**
+             * @param defer_node Only parse the border, so that margins can be set
+             *  right away, and leave the decoration node to build_node(). Used to
+             *  decorate many views in one transaction, and build their nodes once
+             *  it is applied.
+             */
+            simple_decorator_t(wayfire_toplevel_view view, bool defer_node = false);
             ~simple_decorator_t();
+
+            /** Build the decoration node and show it, if it was deferred */
+            void build_node();
+
+            /** @return Whether the decoration node is still to be built */
+            bool is_deferred() const {
+                return !deco;
+            }
+
+            /** Destroy the nodes kept for reuse, along with their textures */
+            static void release_node_pool();
+
+            /** @return The options of the default theme, which decoration nodes are built from */
+            static theme_options get_default_options();
+
+            /**
+             * @return The decorator of a transaction object, or null if it is not a
+             *  decorated toplevel, without any dynamic cast or lookup by type name.
+             */
+            static simple_decorator_t *find(const wf::txn::transaction_object_t *object) {
+                return registry.find(object);
+            }
+
+            wf::toplevel_t *get_toplevel() const {
+                return toplevel;
+            }
+
+            /** @return The margins for the state, computed again only when the border or the state's kind changed */
             wf::decoration_margins_t get_margins( const wf::toplevel_state_t& state );
     };
 }
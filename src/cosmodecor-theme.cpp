@@ -1,4 +1,5 @@
 #include <wayfire/core.hpp>
+#include <wayfire/debug.hpp>
 #include <wayfire/opengl.hpp>
 #include <wayfire/config.h>
 
@@ -8,8 +9,13 @@
 #include <algorithm>
 
 #include "cosmodecor-theme.hpp"
+#include "cosmodecor-profile.hpp"
+#include "cosmodecor-lru.hpp"
 
 #include <filesystem>
+#include <optional>
+#include <tuple>
+#include <dlfcn.h>
 #include <librsvg/rsvg.h>
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
@@ -18,16 +24,126 @@
 
 namespace wf {
     namespace cosmodecor {
+        /**
+         * librsvg and everything it pulls in is only loaded the first time an svg
+         * icon or button style is drawn, themes using pngs never pay for it.
+         */
+        struct rsvg_library_t {
+            decltype(&rsvg_handle_new_from_gfile_sync) new_from_gfile_sync = nullptr;
+            decltype(&rsvg_handle_render_document) render_document = nullptr;
+
+            static rsvg_library_t *get() {
+                static std::optional<rsvg_library_t> library;
+                static bool tried = false;
+                if (!tried) {
+                    tried = true;
+                    profile_scope_t profile{PROFILE_RSVG};
+                    void *handle = dlopen("librsvg-2.so.2", RTLD_NOW | RTLD_LOCAL);
+                    if (handle == nullptr) {
+                        LOGE("cosmodecor: unable to load librsvg, svg images will be blank: ", dlerror());
+                        return nullptr;
+                    }
+
+                    rsvg_library_t loaded;
+                    loaded.new_from_gfile_sync = (decltype(loaded.new_from_gfile_sync))
+                        dlsym(handle, "rsvg_handle_new_from_gfile_sync");
+                    loaded.render_document = (decltype(loaded.render_document))
+                        dlsym(handle, "rsvg_handle_render_document");
+                    if (!loaded.new_from_gfile_sync || !loaded.render_document) {
+                        LOGE("cosmodecor: librsvg is missing symbols, svg images will be blank");
+                        dlclose(handle);
+                        return nullptr;
+                    }
+
+                    library = loaded;
+                }
+
+                return library ? &library.value() : nullptr;
+            }
+        };
+
+        /** A font, as given by the options, at a given scale */
+        using font_key_t = std::tuple<std::string, int, double>;
+
+        /**
+         * A Pango context and layout per font and scale, shared by all themes, so
+         * that fontconfig is queried once and text is measured without allocating
+         * a cairo surface each time.
+         */
+        struct text_font_t {
+            PangoContext *context;
+            PangoLayout *layout;
+        };
+
+        /** Fonts are rarely changed, a few sizes and scales are all there is */
+        static constexpr size_t MAX_FONTS = 8;
+        static std::map<font_key_t, text_font_t> text_fonts;
+
+        /** Text extents per text, font and scale, in logical pixels */
+        static lru_cache_t<std::tuple<std::string, font_key_t>, wf::dimensions_t> text_sizes{256};
+
+        /** The icon theme from GSettings, read on every icon cache miss so that changes to it are followed */
+        static std::string get_icon_theme() {
+            profile_scope_t profile{PROFILE_GSETTINGS};
+            GSettings *gsettings = g_settings_new("org.gnome.desktop.interface");
+            gchar *icon_theme_value = g_settings_get_string(gsettings, "icon-theme");
+            std::string icon_theme = std::string(icon_theme_value);
+            g_free(icon_theme_value);
+            g_object_unref(gsettings);
+            return icon_theme;
+        }
+
+        bool theme_options::operator ==(const theme_options& other) const {
+            return (font == other.font) && (font_size == other.font_size) &&
+                   (active_title == other.active_title) && (inactive_title == other.inactive_title) &&
+                   (max_title_size == other.max_title_size) && (border_size == other.border_size) &&
+                   (active_border == other.active_border) && (inactive_border == other.inactive_border) &&
+                   (corner_radius == other.corner_radius) && (outline_size == other.outline_size) &&
+                   (active_outline == other.active_outline) && (inactive_outline == other.inactive_outline) &&
+                   (button_size == other.button_size) && (button_style == other.button_style) &&
+                   (icon_size == other.icon_size) && (active_accent == other.active_accent) &&
+                   (inactive_accent == other.inactive_accent) && (padding_size == other.padding_size) &&
+                   (layout == other.layout) && (ignore_views == other.ignore_views) &&
+                   (debug_mode == other.debug_mode) && (round_on == other.round_on);
+        }
+
         /** Create a new theme with the default parameters */
         decoration_theme_t::decoration_theme_t(wf::cosmodecor::theme_options options) :
-            theme_options{options} {}
+            theme_options{options} {
+            round_on_mask = 0;
+            std::stringstream round_on_str(round_on.get_value());
+            std::string corner;
+            while (round_on_str >> corner) {
+                if (corner == "all") {
+                    round_on_mask = CORNER_ALL;
+                    break;
+                } else if (corner == "tr") {
+                    round_on_mask |= CORNER_TR;
+                } else if (corner == "tl") {
+                    round_on_mask |= CORNER_TL;
+                } else if (corner == "bl") {
+                    round_on_mask |= CORNER_BL;
+                } else if (corner == "br") {
+                    round_on_mask |= CORNER_BR;
+                }
+            }
 
-        std::string decoration_theme_t::get_layout() const {
+            features = FEATURE_NONE;
+            if (outline_size.get_value() > 0) {
+                features |= FEATURE_OUTLINE;
+            }
+            /** Corners keep their width even when not in round_on, so only the radius counts */
+            if (corner_radius.get_value() > 0) {
+                features |= FEATURE_ROUNDED;
+            }
+        }
+
+        const std::string& decoration_theme_t::get_layout() const {
             return layout.get_value();
         }
 
         /* Size return functions */
-        std::string decoration_theme_t::get_border_size() const {
+        const std::string& decoration_theme_t::get_border_size() const {
             return border_size.get_value();
         }
         int decoration_theme_t::get_corner_radius() const {
@@ -51,9 +167,15 @@ namespace wf {
         int decoration_theme_t::get_padding_size() const {
             return padding_size.get_value();
         }
-        std::string decoration_theme_t::get_round_on() const {
+        const std::string& decoration_theme_t::get_round_on() const {
             return round_on.get_value();
         }
+        uint32_t decoration_theme_t::get_round_on_mask() const {
+            return round_on_mask;
+        }
+        uint32_t decoration_theme_t::get_features() const {
+            return features;
+        }
 
         /* Color return functions */
         color_set_t decoration_theme_t::get_border_colors() const {
@@ -101,33 +223,59 @@ namespace wf {
             return debug_mode.get_value();
         }
 
-        wf::dimensions_t decoration_theme_t::get_text_size(std::string text, int width, double scale) const {
-            const auto format = CAIRO_FORMAT_ARGB32;
-            auto surface = cairo_image_surface_create(format, width, font_size.get_value());
-            auto cr = cairo_create(surface);
+        PangoLayout *decoration_theme_t::get_text_layout(double scale) const {
+            font_key_t key = { font.get_value(), font_size.get_value(), scale };
+            auto it = text_fonts.find(key);
+            if (it == text_fonts.end()) {
+                if (text_fonts.size() >= MAX_FONTS) {
+                    release_text_cache();
+                }
 
-            PangoFontDescription *font_desc;
-            PangoLayout *layout;
-            PangoRectangle text_size;
+                auto *font_desc = pango_font_description_from_string(std::get<0>(key).c_str());
+                pango_font_description_set_absolute_size(font_desc, std::get<1>(key) * PANGO_SCALE * scale);
+
+                text_font_t text_font;
+                text_font.context = pango_font_map_create_context(pango_cairo_font_map_get_default());
+                text_font.layout  = pango_layout_new(text_font.context);
+                pango_layout_set_font_description(text_font.layout, font_desc);
+                pango_font_description_free(font_desc);
+                it = text_fonts.emplace(key, text_font).first;
+            }
+
+            return it->second.layout;
+        }
 
-            font_desc = pango_font_description_from_string(((std::string)font.get_value()).c_str());
-            pango_font_description_set_absolute_size(font_desc, font_size.get_value() * PANGO_SCALE * scale);
-            layout = pango_cairo_create_layout(cr);
-            pango_layout_set_font_description(layout, font_desc);
+        void decoration_theme_t::release_text_cache() {
+            for (auto& [key, text_font] : text_fonts) {
+                g_object_unref(text_font.layout);
+                g_object_unref(text_font.context);
+            }
+
+            text_fonts.clear();
+            text_sizes.clear();
+        }
+
+        wf::dimensions_t decoration_theme_t::get_text_size(std::string text, double scale) const {
+            phase_scope_t phase{PHASE_TEXT_SIZE};
+            auto key = std::make_tuple(text, font_key_t{ font.get_value(), font_size.get_value(), scale });
+            if (auto size = text_sizes.get(key)) {
+                return *size;
+            }
+
+            profile_scope_t profile{PROFILE_PANGO};
+            PangoRectangle text_size;
+            auto layout = get_text_layout(scale);
             pango_layout_set_text(layout, text.c_str(), text.size());
             pango_layout_get_pixel_extents(layout, NULL, &text_size);
-            pango_font_description_free(font_desc);
-            g_object_unref(layout);
-            cairo_destroy(cr);
-            cairo_surface_destroy(surface);
 
             // FIXME: tricky
-            return { text_size.width / scale, text_size.height / scale };
+            return text_sizes.put(key, { (int)(text_size.width / scale), (int)(text_size.height / scale) });
         }
 
         cairo_surface_t* decoration_theme_t::form_title(std::string text,
-                                                        wf::dimensions_t title_size, bool active, orientation_t orientation, double scale) const {
-            const auto format = CAIRO_FORMAT_ARGB32;
+                                                        wf::dimensions_t title_size, orientation_t orientation, double scale) const {
+            phase_scope_t phase{PHASE_FORM_TITLE};
+            const auto format = CAIRO_FORMAT_A8;
             cairo_surface_t* surface;
             if (orientation == HORIZONTAL) {
                 surface = cairo_image_surface_create(format, title_size.width, title_size.height);
@@ -135,90 +283,47 @@ namespace wf {
                 surface = cairo_image_surface_create(format, title_size.height, title_size.width);
             }
 
-            wf::color_t color = (active) ? active_title.get_value() : inactive_title.get_value();
+            if (text.empty()) {
+                return surface;
+            }
+
+            profile_scope_t profile{PROFILE_PANGO};
 
             auto cr = cairo_create(surface);
+            auto layout = get_text_layout(scale);
             if (orientation == VERTICAL) {
                 double radius = (double)title_size.width / 2;;
                 cairo_translate(cr, radius, radius);
                 cairo_rotate(cr, -M_PI / 2);
                 cairo_translate(cr, -radius, -radius);
+                pango_cairo_update_layout(cr, layout);
             }
 
-            PangoFontDescription *font_desc;
-            PangoLayout *layout;
-
-            // render text
-            font_desc = pango_font_description_from_string(((std::string)font.get_value()).c_str());
-            pango_font_description_set_absolute_size(font_desc, font_size.get_value() * PANGO_SCALE * scale);
-
-            layout = pango_cairo_create_layout(cr);
-            pango_layout_set_font_description(layout, font_desc);
+            // render text, ending with an ellipsis if it is wider than the title
             pango_layout_set_text(layout, text.c_str(), text.size());
-            cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+            pango_layout_set_width(layout, title_size.width * PANGO_SCALE);
+            pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+            cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
             pango_cairo_show_layout(cr, layout);
-            pango_font_description_free(font_desc);
-            g_object_unref(layout);
             cairo_destroy(cr);
 
-            return surface;
-        }
-
-        // render_corners
-
-cairo_surface_t *decoration_theme_t::form_corner(bool active, int r, 
-                                                 matrix<double> m, 
-                                                 int height) const {
-    double c_r = corner_radius.get_value() * abs(m.xx);
-	double o_r = c_r - abs(m.xx) * (double)outline_size.get_value() / 2;
-
-    const auto format = CAIRO_FORMAT_ARGB32;
-    auto *surface = cairo_image_surface_create(format, c_r, height);
-    auto cr = cairo_create(surface);
-
-    cairo_translate(cr, c_r / 2, (double)height / 2);
-    cairo_scale(cr, m.xx, m.yy);
-    cairo_translate(cr, -c_r / 2, -(double)height / 2);
-
-    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-    /* Border */
-	wf::color_t color = active ? active_border.get_value() :
-                        inactive_border.get_value();
-    cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-    if (r > 0) {
-        cairo_move_to(cr, 0, (int)(height - c_r));
-        cairo_arc(cr, 0, (int)(height - c_r), c_r, 0, M_PI / 2);
-        cairo_fill(cr);
-
-        cairo_rectangle(cr, 0, 0, c_r, height - c_r);
-        cairo_fill(cr);
-    } else {
-        cairo_rectangle(cr, 0, 0, c_r, height);
-        cairo_fill(cr);
-    }
+            /** Measurements need the full width of the text */
+            pango_layout_set_width(layout, -1);
+            pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_NONE);
 
-    /* Outline */
-	color = active ? active_outline.get_value() : inactive_outline.get_value();
-    cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
-    cairo_set_line_width(cr, outline_size.get_value() * abs(m.xx));
-    if (r > 0) {
-        cairo_move_to(cr, o_r, 0);
-        cairo_line_to(cr, o_r, height - c_r);
-        cairo_arc(cr, 0, (int)(height - c_r), o_r, 0, M_PI / 2);
-        cairo_stroke(cr);
-    } else {
-        cairo_move_to(cr, o_r, 0);
-        cairo_line_to(cr, o_r, height - c_r + o_r);
-        cairo_line_to(cr, 0, height - c_r + o_r);
-    }
-    cairo_stroke(cr);
-    cairo_destroy(cr);
+            /** Measurements are done without any rotation */
+            if (orientation == VERTICAL) {
+                pango_context_set_matrix(pango_layout_get_context(layout), nullptr);
+                pango_layout_context_changed(layout);
+            }
 
-    return surface;
-}
+            return surface;
+        }
 
         cairo_surface_t *decoration_theme_t::form_button(button_type_t button, double hover,
                                                          bool active, bool maximized, double scale) const {
+            phase_scope_t phase{PHASE_FORM_BUTTON};
+            profile_scope_t profile{PROFILE_CAIRO};
             if ((std::string)button_style.get_value() != "wayfire" &&
                 (std::string)button_style.get_value() != "cosmodecor" &&
                 (std::string)button_style.get_value() != "simple") {
@@ -429,11 +534,28 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
             auto cr = cairo_create(surface);
             auto cr_rsvg = cairo_create(surface_rsvg);
 
+            auto rsvg = rsvg_library_t::get();
+            if (rsvg == nullptr) {
+                cairo_destroy(cr_rsvg);
+                cairo_surface_destroy(surface_rsvg);
+                cairo_destroy(cr);
+                return surface;
+            }
+
+            profile_scope_t profile{PROFILE_RSVG};
             GFile *file = g_file_new_for_path(path.c_str());
-            RsvgHandle *svg = rsvg_handle_new_from_gfile_sync(file, RSVG_HANDLE_FLAGS_NONE,
-                                                              NULL, NULL);
+            RsvgHandle *svg = rsvg->new_from_gfile_sync(file, RSVG_HANDLE_FLAGS_NONE,
+                                                        NULL, NULL);
+            if (svg == nullptr) {
+                g_object_unref(file);
+                cairo_destroy(cr_rsvg);
+                cairo_surface_destroy(surface_rsvg);
+                cairo_destroy(cr);
+                return surface;
+            }
+
             RsvgRectangle rect { 0, 0, (double)size, (double)size };
-            rsvg_handle_render_document(svg, cr_rsvg, &rect, nullptr);
+            rsvg->render_document(svg, cr_rsvg, &rect, nullptr);
             cairo_destroy(cr_rsvg);
 
             cairo_translate(cr, (double)size / 2, (double)size / 2);
@@ -504,6 +626,7 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
         }
 
         cairo_surface_t *decoration_theme_t::form_icon(std::string app_id, double scale) const {
+            phase_scope_t phase{PHASE_FORM_ICON};
             std::string line;
             std::string icons = (std::string)getenv("HOME") + "/.local/share/cosmodecor_icons";
             std::ofstream icon_file_out(icons, std::ofstream::out | std::ofstream::app);
@@ -627,10 +750,7 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
 
                 /* Check for the existance of the icon_theme.get_value() on all reasonable locations */
 
-                GSettings *gsettings = g_settings_new("org.gnome.desktop.interface");
-                gchar *icon_theme_value     = g_settings_get_string(gsettings, "icon-theme");
-
-                std::string icon_theme = std::string(icon_theme_value);
+                std::string icon_theme = get_icon_theme();
 
                 for (auto icon_dir : icon_dirs) {
                     if (auto dir = icon_dir + icon_theme;
@@ -641,8 +761,6 @@ cairo_surface_t *decoration_theme_t::form_corner(bool active, int r,
                         }
                     }
                 }
-                g_free(icon_theme_value);
-                g_object_unref(gsettings);
 
                 for (auto icon_theme : default_icon_themes) {
                     if (exists(icon_theme)) {
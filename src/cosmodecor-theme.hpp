@@ -1,5 +1,6 @@
 #pragma once
 #include <wayfire/render-manager.hpp>
+#include <pango/pango.h>
 
 #include "cosmodecor-buttons.hpp"
 
@@ -35,6 +36,23 @@ namespace wf {
             EDGE_RIGHT  = 3
         };
 
+        /** Optional parts of the frame, used to pick a specialized renderer */
+        enum theme_feature_t : uint32_t {
+            FEATURE_NONE    = 0,
+            FEATURE_OUTLINE = (1 << 0),
+            FEATURE_ROUNDED = (1 << 1),
+            FEATURE_ALL     = FEATURE_OUTLINE | FEATURE_ROUNDED
+        };
+
+        /** The corners named by the round_on option */
+        enum corner_bit_t : uint32_t {
+            CORNER_TR  = (1 << 0),
+            CORNER_TL  = (1 << 1),
+            CORNER_BL  = (1 << 2),
+            CORNER_BR  = (1 << 3),
+            CORNER_ALL = CORNER_TR | CORNER_TL | CORNER_BL | CORNER_BR
+        };
+
         /**
          * Checks if a file exists in storage
          * @param path The path of the file to find
@@ -66,10 +84,14 @@ namespace wf {
             theme_option_t(T value) :
                 value{value} {}
 
-            T get_value() const {
+            const T& get_value() const {
                 return value;
             }
 
+            bool operator ==(const theme_option_t& other) const {
+                return value == other.value;
+            }
+
         private:
             T value;
         };
@@ -105,18 +127,25 @@ namespace wf {
             theme_option_t<std::string> ignore_views;
             theme_option_t<bool> debug_mode;
             theme_option_t<std::string> round_on;
+
+            bool operator ==(const theme_options& other) const;
         };
 
         class decoration_theme_t : private theme_options {
         public:
             decoration_theme_t(theme_options extra_options);
 
+            /** @return The options the theme was built from */
+            const theme_options& get_theme_options() const {
+                return *this;
+            }
+
             /** @return The theme's layout */
-            std::string get_layout() const;
+            const std::string& get_layout() const;
 
             /* Size return functions */
             /** @return The available border for resizing */
-            std::string get_border_size() const;
+            const std::string& get_border_size() const;
             /** @return The font size */
             int get_font_size() const;
             /** @return The maximum text size, in pixels */
@@ -148,32 +177,28 @@ namespace wf {
             /** @return True if debug_mode is on */
             bool get_debug_mode() const;
             /** @return Where corners should be drawn */
-            std::string get_round_on() const;
+            const std::string& get_round_on() const;
+            /** @return The corners to round, as a mask of corner_bit_t */
+            uint32_t get_round_on_mask() const;
+            /** @return The theme_feature_t bits this theme makes use of */
+            uint32_t get_features() const;
 
             /**
              * Get what the title size should be, given a text for the title, useful for
              * centered and right positioned layouts on an edge.
              */
-            wf::dimensions_t get_text_size(std::string title, int width, double scale) const;
+            wf::dimensions_t get_text_size(std::string title, double scale) const;
+
+            /** Free the Pango state and text extents shared by all themes */
+            static void release_text_cache();
 
             /**
-             * Render the given text on a cairo_surface_t with the given size.
+             * Render the given text as an A8 coverage mask with the given size, to be
+             * drawn in the title colors.
              * The caller is responsible for freeing the memory afterwards.
              */
             cairo_surface_t *form_title(std::string text, wf::dimensions_t title_size,
-                                        bool active, orientation_t orientation, double scale) const;
-
-            /**
-             * Render the corners for active and inactive windows. 
-             * @param active The activation state of the window.
-             * @param r the radius of the corner.
-             * @param scale The scale of the framebuffer.
-             * @param m The matrix to transform the corner.
-             * @param height The height of the corner, set by radius or the border size.
-             */
-            cairo_surface_t *form_corner(bool active, int r, matrix<double> m, 
-                                        int height) const;
-
+                                        orientation_t orientation, double scale) const;
 
             /**
              * Get the icon for the given button.
@@ -201,6 +226,15 @@ namespace wf {
              * @param title The icon for the window.
              */
             cairo_surface_t *form_icon(std::string app_id, double scale) const;
+
+        private:
+            /** Parsed once from round_on and layout, never on the render path */
+            uint32_t round_on_mask;
+            uint32_t features;
+
+            /** @return The shared layout for this theme's font at the given scale */
+            PangoLayout *get_text_layout(double scale) const;
+
         };
     }
 }
@@ -9,29 +9,40 @@
 
 #include "cosmodecor-subsurface.hpp"
 #include "cosmodecor-theme.hpp"
+#include "cosmodecor-profile.hpp"
+#include "cosmodecor-draw-list.hpp"
+#include "cosmodecor-atlas.hpp"
 #include "wayfire/core.hpp"
 #include "wayfire/signal-provider.hpp"
 #include "wayfire/toplevel-view.hpp"
 #include "wayfire/toplevel.hpp"
 
+#include <optional>
 #include <stdio.h>
 
 class wayfire_cosmodecor_t : public wf::plugin_interface_t {
     wf::view_matcher_t ignore_views{"cosmodecor/ignore_views"};
     wf::option_wrapper_t<std::string> extra_themes{"cosmodecor/extra_themes"};
+    wf::option_wrapper_t<bool> debug_mode{"cosmodecor/debug_mode"};
     wf::config::config_manager_t& config = wf::get_core().config;
+    /** The options of the default theme when views were last decorated by the batch */
+    std::optional<wf::cosmodecor::theme_options> batch_options;
 
     wf::signal::connection_t<wf::txn::new_transaction_signal> on_new_tx = [this] (wf::txn::new_transaction_signal *ev) {
         // For each transaction, we need to consider what happens with participating views
+        bool has_deferred = false;
         for (const auto& obj : ev->tx->get_objects()) {
-            if (auto toplevel = std::dynamic_pointer_cast<wf::toplevel_t>(obj)) {
-                // First check whether the toplevel already has decoration
-                // In that case, we should just set the correct margins
-                if (auto deco = toplevel->get_data<wf::cosmodecor::simple_decorator_t>()) {
-                    toplevel->pending().margins = deco->get_margins(toplevel->pending());
-                    continue;
-                }
+            // First case: the object is a toplevel which already has decoration, as are most
+            // objects during resizes and animations. It is found by its address, without a cast.
+            // In that case, we should just set the correct margins
+            if (auto deco = wf::cosmodecor::simple_decorator_t::find(obj.get())) {
+                auto& pending = deco->get_toplevel()->pending();
+                pending.margins = deco->get_margins(pending);
+                has_deferred |= deco->is_deferred();
+                continue;
+            }
 
+            if (auto toplevel = std::dynamic_pointer_cast<wf::toplevel_t>(obj)) {
                 // Second case: the view is already mapped, or the transaction does not map it.
                 // The view is not being decorated, so nothing to do here.
                 if (toplevel->current().mapped || !toplevel->pending().mapped)
@@ -48,6 +59,38 @@ class wayfire_cosmodecor_t : public wf::plugin_interface_t {
                 }
             }
         }
+
+        // Nodes of batches are built once their transaction is applied, be it the
+        // batch itself, or another transaction it was merged into
+        if (has_deferred) {
+            ev->tx->connect(&on_batch_applied);
+        }
+    };
+
+    /**
+     * Builds the nodes of the views decorated by a batch, once their margins are applied.
+     * Decorators also build them on the view's next geometry change, if the batch is
+     * applied in a way this misses.
+     */
+    wf::signal::connection_t<wf::txn::transaction_applied_signal> on_batch_applied =
+        [] (wf::txn::transaction_applied_signal *ev) {
+            for (const auto& obj : ev->self->get_objects()) {
+                if (auto deco = wf::cosmodecor::simple_decorator_t::find(obj.get())) {
+                    deco->build_node();
+                }
+            }
+        };
+
+    /**
+     * Redecorates every view in one batch when the configuration is reloaded with
+     * new options for the default theme, so that existing views follow them. Reloads
+     * which leave the theme alone, the most common, do nothing.
+     */
+    wf::signal::connection_t<wf::reload_config_signal> on_config_reloaded = [this] (wf::reload_config_signal*) {
+        auto options = wf::cosmodecor::simple_decorator_t::get_default_options();
+        if (batch_options != options) {
+            update_all_decorations(true);
+        }
     };
 
     wf::signal::connection_t<wf::view_decoration_state_updated_signal> on_decoration_state_updated =
@@ -57,21 +100,34 @@ class wayfire_cosmodecor_t : public wf::plugin_interface_t {
 
 public:
     void init() override {
+        auto& profile = wf::cosmodecor::startup_profile_t::get();
+        if (debug_mode) {
+            profile.begin();
+        }
+
+        wf::cosmodecor::phase_profile_t::get().set_enabled(debug_mode);
+        debug_mode.set_callback([this] () {
+            wf::cosmodecor::phase_profile_t::get().set_enabled(debug_mode);
+        });
+
         wf::get_core().connect(&on_decoration_state_updated);
+        wf::get_core().connect(&on_config_reloaded);
         wf::get_core().tx_manager->connect(&on_new_tx);
 
-        for (auto& view : wf::get_core().get_all_views()) {
-            update_view_decoration(view);
-        }
+        size_t views = update_all_decorations(true);
+        profile.end_init(views);
     }
 
     void fini() override {
-        for (auto view : wf::get_core().get_all_views()) {
-            if (auto toplevel = wf::toplevel_cast(view)) {
-                remove_decoration(toplevel);
-                wf::get_core().tx_manager->schedule_object(toplevel->toplevel());
-            }
-        }
+        update_all_decorations(false);
+        wf::cosmodecor::simple_decorator_t::release_node_pool();
+
+        OpenGL::render_begin();
+        wf::cosmodecor::draw_list_t::release_program();
+        OpenGL::render_end();
+        wf::cosmodecor::texture_atlas_t::release_all();
+        wf::cosmodecor::decoration_theme_t::release_text_cache();
+        wf::cosmodecor::phase_profile_t::get().set_enabled(false);
     }
 
     bool ignore_decoration_of_view(wayfire_view view) {
@@ -82,10 +138,50 @@ public:
         return view->should_be_decorated() && !ignore_decoration_of_view(view);
     }
 
-    void adjust_new_decorations(wayfire_toplevel_view view) {
+    /**
+     * Decorate every view which should be, or undecorate every view, in one
+     * transaction, instead of one per view, so that all of them are configured
+     * and committed together. Nodes of views decorated here are only built once
+     * the transaction is applied. Views decorated already lose their old
+     * decoration first, so that their geometry is not expanded twice.
+     *
+     * @return The number of views in the transaction
+     */
+    size_t update_all_decorations(bool decorate) {
+        auto tx = wf::txn::transaction_t::create();
+        size_t views = 0;
+        for (auto& view : wf::get_core().get_all_views()) {
+            if (auto toplevel = wf::toplevel_cast(view)) {
+                if (decorate && should_decorate_view(toplevel)) {
+                    if (toplevel->toplevel()->has_data<wf::cosmodecor::simple_decorator_t>()) {
+                        remove_decoration(toplevel);
+                    }
+
+                    adjust_new_decorations(toplevel, true);
+                } else {
+                    remove_decoration(toplevel);
+                }
+
+                tx->add_object(toplevel->toplevel());
+                views++;
+            }
+        }
+
+        if (views > 0) {
+            wf::get_core().tx_manager->schedule_transaction(std::move(tx));
+        }
+
+        if (decorate) {
+            batch_options = wf::cosmodecor::simple_decorator_t::get_default_options();
+        }
+
+        return views;
+    }
+
+    void adjust_new_decorations(wayfire_toplevel_view view, bool defer_node = false) {
         auto toplevel = view->toplevel();
 
-        toplevel->store_data(std::make_unique<wf::cosmodecor::simple_decorator_t>(view));
+        toplevel->store_data(std::make_unique<wf::cosmodecor::simple_decorator_t>(view, defer_node));
         auto  deco    = toplevel->get_data<wf::cosmodecor::simple_decorator_t>();
         auto& pending = toplevel->pending();
         pending.margins = deco->get_margins(pending);